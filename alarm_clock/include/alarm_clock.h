@@ -0,0 +1,202 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+#include <stdint.h>
+
+// The alarm schedule, and the settings and calendar it's kept with: the part
+// of alarm_clock.cpp that doesn't talk to any device, declared here so that
+// the tests in test/ can reach it too. Everything declared here is defined in
+// alarm_clock.cpp.
+
+enum GlobalState {
+  WAITING,
+  SNOOZING,
+  SOUNDING,
+  SOUNDING_SHABBAT,
+};
+
+enum TimeState : uint8_t {
+  INACTIVE,
+  ACTIVE,
+  SKIP_NEXT,
+  SHABBAT,
+  kMaxTimeState,
+};
+
+struct Time {
+  uint8_t hours24;
+  uint8_t minutes;
+  uint8_t hours12() const;
+  const char* amPMString() const;
+  TimeState state = INACTIVE;
+  Time& operator+=(int minutes);
+  bool operator==(const Time& other) const {
+    return hours24 == other.hours24 && minutes == other.minutes;
+  }
+  bool operator<(const Time& other) const {
+    if (hours24 < other.hours24) {
+      return true;
+    }
+    if (hours24 == other.hours24) {
+      return minutes < other.minutes;
+    }
+    return false;
+  }
+  uint16_t minuteOfDay() const {
+    return hours24 * 60 + minutes;
+  }
+};
+
+// The MP3 files that alarms play, unless they name another.
+constexpr uint8_t kAlarmSound = 1;
+constexpr uint8_t kShabbatSound = 2;
+
+// One entry in the schedule of alarms.
+struct Alarm {
+  // Bit n is set if it goes off on weekday n. 0 if the slot is unused.
+  uint8_t days = 0;
+  Time time;
+  // The MP3 file it plays, or 0 for the default for how it goes off.
+  uint8_t sound = 0;
+};
+
+// A day on the calendar, counted the way the exception calendar stores it.
+struct Date {
+  // Years since 2000, like the RV1805's year register.
+  uint8_t year;
+  // 0 for January 1st.
+  uint16_t day_of_year;
+  Date& operator+=(int days);
+  bool operator==(const Date& other) const {
+    return year == other.year && day_of_year == other.day_of_year;
+  }
+  bool operator<(const Date& other) const {
+    return year != other.year ? year < other.year
+                              : day_of_year < other.day_of_year;
+  }
+  void toMonthDate(uint8_t* month, uint8_t* date) const;
+  static Date From(uint8_t year, uint8_t month, uint8_t date);
+};
+
+// One reading of the RTC, taken by tasks::ReadClock. Everything that makes a
+// decision based on the time works from the same snapshot, so that the clock
+// can't tick over to the next second or minute halfway through a decision.
+struct ClockSnapshot {
+  // Years since 2000.
+  uint8_t year;
+  uint8_t month;
+  uint8_t weekday;
+  // Day of the month, 1-31.
+  uint8_t date;
+  uint8_t hours24;
+  uint8_t minutes;
+  uint8_t seconds;
+  // millis() when the snapshot was taken.
+  unsigned long millis;
+  // The time of day, as an ACTIVE Time.
+  Time time() const;
+  Date day() const;
+  // Minutes since midnight at the start of Sunday.
+  uint16_t MinuteOfWeek() const;
+  // Reads the RTC into *snapshot. Returns false, and leaves *snapshot as it
+  // was, if the RTC didn't answer or any field is out of range.
+  static bool Take(ClockSnapshot* snapshot);
+};
+
+// How many alarms the schedule holds. Each costs 6 bytes of RAM (its entry,
+// and its place in AlarmIndex), 5 bytes of stack while a batch of settings
+// arrives on the console, and a record in the EEPROM.
+constexpr uint8_t kMaxAlarms = 14;
+
+struct PersistentSettings {
+  // In no particular order, with unused slots anywhere. AlarmIndex sorts
+  // them.
+  Alarm alarms[kMaxAlarms];
+  bool alarms_off;
+  uint8_t snooze_length;
+};
+
+// The slots of persistent_settings.alarms that are in use, in the order they
+// go off during a day, so that finding the next alarm after a given minute is
+// a binary search for the minute, then a walk forward to the first alarm on
+// that weekday. Alarms go off on several weekdays each, so they're sorted by
+// time of day rather than by minute of the week: sorting every day's copy of
+// each alarm would take 7 times the RAM.
+//
+// Sort() has to be called whenever an alarm's days or time change.
+struct AlarmIndex {
+  void Sort();
+  // Finds the first alarm that isn't INACTIVE at minute_of_week or later,
+  // wrapping around from the end of the week to the start. Returns false if
+  // there is none. Bit d of skip_days passes over the d'th day from
+  // minute_of_week's, 0-7, the last being the same weekday a week later.
+  bool Find(uint16_t minute_of_week, uint8_t skip_days, uint8_t* slot,
+            uint16_t* minutes_until) const;
+  // The first position in order at or after minute_of_day.
+  uint8_t LowerBound(uint16_t minute_of_day) const;
+  // The slot at position i.
+  uint8_t operator[](uint8_t i) const { return order_[i]; }
+  uint8_t length() const { return length_; }
+
+  private:
+  uint8_t order_[kMaxAlarms];
+  uint8_t length_ = 0;
+};
+
+// The next alarm that will go off, so that the display and the stop button
+// don't have to search the schedule every time they need it.
+//
+// Recompute() searches again, and has to be called whenever
+// persistent_settings, the clock, or the state change. Tick() is called once
+// a minute to count down minutes_until, and only searches again once the
+// alarm's minute has gone by.
+struct NextAlarm {
+  // The weekday it goes off on, or -1 if there is no alarm set.
+  int8_t day = -1;
+  // Its slot in persistent_settings.alarms.
+  uint8_t slot = 0;
+  // A copy of its time, including its state, which is SHABBAT for an ACTIVE
+  // alarm on a holiday.
+  Time time;
+  // Minutes from the last Tick() until the alarm goes off.
+  int minutes_until = 0;
+  void Recompute(const ClockSnapshot& now);
+  void Tick(const ClockSnapshot& now);
+
+  private:
+  // now.MinuteOfWeek() as of the last Tick() or Recompute().
+  uint16_t minute_of_week_ = 0;
+};
+
+// Years count from 2000, like the RV1805's.
+uint8_t DaysInMonth(uint8_t year, uint8_t month);
+uint16_t DaysInYear(uint8_t year);
+uint8_t Weekday(uint8_t year, uint8_t month, uint8_t date);
+
+extern GlobalState state;
+extern PersistentSettings persistent_settings;
+extern AlarmIndex alarm_index;
+extern NextAlarm next_alarm;
+
+// Keeps persistent_settings in the EEPROM.
+namespace storage {
+void Load();
+void Save();
+} // namespace storage
+
+// Dates on which the alarms don't follow the weekly schedule: days off, when
+// none of them go off, and holidays, when the ones that are ACTIVE go off as
+// shabbat alarms instead. It covers the clock's year and the next, one bit
+// per day, kept in the EEPROM alongside persistent_settings.
+namespace calendar {
+enum Flag : uint8_t {
+  kOff,
+  kHoliday,
+  kNumFlags,
+};
+bool IsSet(Flag flag, const Date& day);
+bool InRange(const Date& day, const Date& today);
+void SetRange(Flag flag, Date from, const Date& to, bool on);
+bool NextRange(Flag flag, const Date& today, Date* from, Date* to);
+void Clear();
+} // namespace calendar
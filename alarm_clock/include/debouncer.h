@@ -0,0 +1,95 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+#include <stdint.h>
+#include "ring_buffer.h"
+
+namespace debouncer {
+
+enum EventType : uint8_t {
+  kPress,
+  // Sent once, if a button is still held long_press_millis after its press.
+  // The release follows as usual.
+  kLongPress,
+  kRelease,
+};
+
+struct Event {
+  uint8_t button;
+  EventType type;
+  // When the event was recognized, in millis().
+  unsigned long millis;
+};
+
+// Debounces up to 8 buttons by sampling them, rather than by reacting to
+// their interrupts.
+//
+// sample() is meant to be called from a timer interrupt about once a
+// millisecond. A button's debounced state only changes once its raw reading
+// has disagreed with it for window_millis samples in a row, so contact bounce
+// shorter than that is never seen, and a real press is recognized
+// window_millis after it starts. The resulting events wait in a queue for the
+// main program to take().
+template <uint8_t N>
+class Debouncer {
+  static_assert(N <= 8, "pressed_ is a bit mask");
+
+  public:
+    Debouncer(uint8_t window_millis, uint16_t long_press_millis):
+        window_(window_millis), long_press_(long_press_millis) {}
+
+    // `raw` is whether `button` reads as pressed right now. Returns whether
+    // an event was queued.
+    bool sample(uint8_t button, bool raw, unsigned long now) {
+      Button& b = buttons_[button];
+      const bool pressed = this->pressed(button);
+      if (raw == pressed) {
+        b.count = 0;
+        if (pressed && !b.long_sent && now - b.since >= long_press_) {
+          b.long_sent = true;
+          return Queue(button, kLongPress, now);
+        }
+        return false;
+      }
+      if (++b.count < window_) return false;
+      b.count = 0;
+      if (raw) {
+        pressed_ |= 1 << button;
+        b.since = now;
+        b.long_sent = false;
+        return Queue(button, kPress, now);
+      }
+      pressed_ &= ~(1 << button);
+      return Queue(button, kRelease, now);
+    }
+
+    // The debounced state.
+    bool pressed(uint8_t button) const { return pressed_ & (1 << button); }
+    bool any_pressed() const { return pressed_ != 0; }
+
+    // Returns false if there are no events.
+    bool take(Event* e) { return events_.pop(e); }
+
+  private:
+    struct Button {
+      // Consecutive samples that disagreed with the debounced state.
+      uint8_t count = 0;
+      bool long_sent = false;
+      // When the current press was recognized.
+      unsigned long since = 0;
+    };
+
+    bool Queue(uint8_t button, EventType type, unsigned long now) {
+      // If the main program has fallen that far behind, dropping the event
+      // is the least of its problems.
+      return events_.push({button, type, now});
+    }
+
+    const uint8_t window_;
+    const uint16_t long_press_;
+    Button buttons_[N];
+    volatile uint8_t pressed_ = 0;
+    ring_buffer::RingBuffer<Event, 8> events_;
+};
+
+} // namespace debouncer
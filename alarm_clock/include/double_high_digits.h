@@ -17,6 +17,7 @@
 #pragma once
 
 #include <avr/pgmspace.h>
+#include <string.h>
 #include <Print.h>
 
 namespace double_high_digits {
@@ -133,11 +134,85 @@ void Install(LCD& lcd) {
   }
 }
 
+// Why did I identify this character in binary?
+// That's the way it's printed on the HD44780 data sheet.
+constexpr uint8_t kColon = 0b10100101;
+
+// Looks up the top and bottom halves of c. Returns false if c has no double
+// high form.
+inline bool Glyph(uint8_t c, uint8_t* top, uint8_t* bottom) {
+  if ('0' <= c && c <= '9') {
+    *top = pgm_read_byte(&kDigitParts[c - '0'].top);
+    *bottom = pgm_read_byte(&kDigitParts[c - '0'].bottom);
+    return true;
+  }
+  if (c == ':') {
+    *top = *bottom = kColon;
+    return true;
+  }
+  if (c == ' ') {
+    *top = *bottom = ' ';
+    return true;
+  }
+  return false;
+}
+
+// A render target for Writer that holds two rows of WIDTH characters in
+// RAM, so that a string can be composed without any device calls at all.
+// flush() then sends it to an LCD with one setCursor and one write per row.
+template <size_t WIDTH = 16>
+class Cells {
+  private:
+    uint8_t cells_[2][WIDTH];
+    uint8_t column_ = 0;
+    uint8_t row_ = 0;
+    // How many columns have been written to.
+    uint8_t width_ = 0;
+
+  public:
+    Cells() {
+      clear();
+    }
+
+    void clear() {
+      memset(cells_, ' ', sizeof(cells_));
+      width_ = 0;
+    }
+
+    void setCursor(uint8_t col, uint8_t row) {
+      column_ = col;
+      row_ = row;
+    }
+
+    size_t write(const uint8_t* buffer, size_t size) {
+      if (row_ >= 2) return 0;
+      size_t n = 0;
+      for (; n < size && column_ < WIDTH; n++) {
+        cells_[row_][column_++] = buffer[n];
+      }
+      if (column_ > width_) width_ = column_;
+      return n;
+    }
+
+    // Writes the rows to lcd at (col, row) and (col, row + 1).
+    template <class LCD>
+    void flush(LCD& lcd, uint8_t col, uint8_t row) const {
+      for (uint8_t r = 0; r < 2; r++) {
+        lcd.setCursor(col, row + r);
+        lcd.write(cells_[r], width_);
+      }
+    }
+};
+
 // Templated so that it works with both SerLCD and LiquidCrystal
-// (and any other class that implements the same interface).
+// (and any other class that implements the same interface), as well as
+// Cells.
 // The Writer class is separate from the install class, so that you
-// can Install directly to an LCD device, and write somewhere else (e.g. a
-// buffer class that will later be written to the LCD in one shot.)
+// can Install directly to an LCD device, and write somewhere else (e.g.
+// Cells, which will later be written to the LCD in one shot.)
+//
+// Each call to write() costs two setCursor calls and two writes on the
+// target, so print whole strings rather than one character at a time.
 template <class LCD, size_t WIDTH = 16>
 class Writer : public Print {
   private:
@@ -154,70 +229,23 @@ class Writer : public Print {
     }
 
     size_t write(const uint8_t* buffer, size_t size) override {
-      uint8_t outBuf[WIDTH];
-      uint8_t* op = outBuf;
-      for (const uint8_t* cp = buffer; cp < buffer + size ; cp++) {
-        char c = *cp;
-        if ('0' <= c && c <= '9') {
-          *op++ = pgm_read_byte(&kDigitParts[c - '0'].top);
-        }
-        if ( c == ':') {
-          *op++ = 0b10100101;
-        }
-        if (c == ' ') {
-          *op++ = ' ';
-        }
+      uint8_t top[WIDTH];
+      uint8_t bottom[WIDTH];
+      size_t n = 0;
+      for (size_t i = 0; i < size && n < WIDTH; i++) {
+        if (Glyph(buffer[i], &top[n], &bottom[n])) n++;
       }
+      if (n == 0) return 0;
       lcd_.setCursor(column_, row_);
-      lcd_.write(outBuf, op - outBuf);
-
-      op = outBuf;
-      for (const uint8_t* cp = buffer; cp < buffer + size ; cp++) {
-        char c = *cp;
-        if ('0' <= c && c <= '9') {
-          *op++ = pgm_read_byte(&kDigitParts[c - '0'].bottom);
-        }
-        if ( c == ':') {
-          *op++ = 0b10100101;
-        }
-        if (c == ' ') {
-          *op++ = ' ';
-        }
-      }
+      lcd_.write(top, n);
       lcd_.setCursor(column_, row_ + 1);
-      lcd_.write(outBuf, op - outBuf);
-      column_ += op - outBuf;
-      return op - outBuf;
+      lcd_.write(bottom, n);
+      column_ += n;
+      return n;
     }
 
     size_t write(uint8_t c) override {
-      if ('0' <= c && c <= '9') {
-        lcd_.setCursor(column_, row_);
-        lcd_.writeChar(pgm_read_byte(&kDigitParts[c - '0'].top));
-        lcd_.setCursor(column_, row_ + 1);
-        lcd_.writeChar(pgm_read_byte(&kDigitParts[c - '0'].bottom));
-        column_++;
-        return 1;
-      }
-      if (c == ':') {
-        lcd_.setCursor(column_, row_);
-        // Why did I identify this character in binary?
-        // That's the way it's printed on the HD44780 data sheet.
-        lcd_.write(0b10100101);
-        lcd_.setCursor(column_, row_ + 1);
-        lcd_.write(0b10100101);
-        column_++;
-        return 1;
-      }
-      if (c == ' ') {
-        lcd_.setCursor(column_, row_);
-        lcd_.write(' ');
-        lcd_.setCursor(column_, row_ + 1);
-        lcd_.write(' ');
-        column_++;
-        return 1;
-      }
-      return 0;
+      return write(&c, 1);
     }
 };
 
@@ -0,0 +1,205 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+#include <stdint.h>
+#include <util/crc16.h>
+
+namespace eeprom_journal {
+
+// A small key-value store of fixed-size records that spreads its writes over
+// a region of EEPROM.
+//
+// The region is divided into 8-byte slots, each holding one copy of one
+// record:
+//
+//   [sequence number, 2 bytes][record id][payload, 4 bytes][CRC-8]
+//
+// Writes always go to the slot after the most recently written one (the
+// head), wrapping around at the end of the region, so every slot is written
+// equally often. At boot, begin() reads every slot once, and keeps, for each
+// record, the slot holding its newest copy with a valid CRC. Copies
+// that were cut short by a power failure fail their CRC, and the previous
+// copy of that record is used instead.
+//
+// So that there always is a previous copy, the head never holds the newest
+// copy of any record: a slot is only written once nothing needs what's in
+// it. When the slot after the head holds the newest copy of another record,
+// that copy moves into the head first, with a new sequence number, which
+// frees the slot after it. That way every record is rewritten once per trip
+// around the region, so the sequence numbers in use always span less than
+// one trip and can be compared with wraparound.
+//
+// write() does nothing if the record already holds that payload, so saving
+// settings that mostly haven't changed only costs the records that did.
+//
+// Storage is EEPROMClass, or anything else with the same read(), update() and
+// length().
+template <class Storage, uint8_t kRecords>
+class Journal {
+  public:
+    static constexpr uint8_t kPayloadSize = 4;
+    typedef uint8_t Payload[kPayloadSize];
+
+    // Uses bytes [begin, end) of storage, which must hold at least
+    // kRecords + 1 slots, and at most 255.
+    Journal(Storage& storage, uint16_t begin, uint16_t end):
+      storage_(storage), begin_(begin), slots_((end - begin) / kSlotSize) {}
+
+    // Finds the newest copy of each record. Returns how many records were
+    // found.
+    uint8_t begin() {
+      uint8_t found = 0;
+      bool any = false;
+      uint16_t newest = 0;
+      head_ = 0;
+      for (uint8_t id = 0; id < kRecords; id++) live_[id] = kNone;
+      for (uint8_t s = 0; s < slots_; s++) {
+        uint16_t seq;
+        uint8_t id;
+        if (!ReadSlot(s, &seq, &id)) continue;
+        if (live_[id] == kNone) {
+          found++;
+          live_[id] = s;
+        } else if (Newer(seq, SeqAt(live_[id]))) {
+          live_[id] = s;
+        }
+        if (!any || Newer(seq, newest)) {
+          any = true;
+          newest = seq;
+          head_ = (s + 1) % slots_;
+        }
+      }
+      // Versions that rewrote records in place could leave the head on one.
+      // There's always a free slot, since there are more slots than records.
+      while (OwnerOf(head_) != kNone) head_ = (head_ + 1) % slots_;
+      seq_ = newest + 1;
+      return found;
+    }
+
+    // Forgets every record, e.g. before writing records in a new format.
+    // Costs one byte written per slot that isn't already blank.
+    void format() {
+      for (uint8_t s = 0; s < slots_; s++) {
+        storage_.update(SlotAddress(s) + kIdOffset, kNone);
+      }
+      for (uint8_t id = 0; id < kRecords; id++) live_[id] = kNone;
+      head_ = 0;
+    }
+
+    // Copies the newest copy of record id into payload. Returns false if
+    // the record has never been written.
+    bool read(uint8_t id, Payload& payload) {
+      if (live_[id] == kNone) return false;
+      const uint16_t addr = SlotAddress(live_[id]) + kPayloadOffset;
+      for (uint8_t i = 0; i < kPayloadSize; i++) {
+        payload[i] = storage_.read(addr + i);
+      }
+      return true;
+    }
+
+    // Stores a new copy of record id, unless it already holds payload.
+    // Returns whether anything was written. If the power fails partway
+    // through, every record still has a valid copy: id's old one or its new
+    // one, and the others' as they were.
+    bool write(uint8_t id, const Payload& payload) {
+      if (live_[id] != kNone && Holds(live_[id], payload)) return false;
+      while (true) {
+        const uint8_t s = head_;
+        head_ = (head_ + 1) % slots_;
+        const uint8_t owner = OwnerOf(head_);
+        if (owner == kNone || owner == id) {
+          // id's old copy, if it was there, is the one being replaced.
+          WriteSlot(s, id, payload);
+          live_[id] = s;
+          return true;
+        }
+        Payload other;
+        read(owner, other);
+        WriteSlot(s, owner, other);
+        live_[owner] = s;
+      }
+    }
+
+  private:
+    static constexpr uint8_t kSlotSize = 8;
+    static constexpr uint8_t kIdOffset = 2;
+    static constexpr uint8_t kPayloadOffset = 3;
+    static constexpr uint8_t kCrcOffset = kPayloadOffset + kPayloadSize;
+    static constexpr uint8_t kNone = 0xFF;
+    // Not zero, so that a slot of all zeros isn't valid.
+    static constexpr uint8_t kCrcInit = 0xFF;
+
+    Storage& storage_;
+    const uint16_t begin_;
+    const uint8_t slots_;
+    // The slot holding the newest copy of each record, or kNone.
+    uint8_t live_[kRecords];
+    // The next slot to write, which never holds the newest copy of a record.
+    uint8_t head_ = 0;
+    // The sequence number of the next copy written.
+    uint16_t seq_ = 0;
+
+    // Whether sequence number a was written after b.
+    static bool Newer(uint16_t a, uint16_t b) {
+      return static_cast<int16_t>(a - b) > 0;
+    }
+
+    uint16_t SlotAddress(uint8_t s) const {
+      return begin_ + static_cast<uint16_t>(s) * kSlotSize;
+    }
+
+    uint16_t SeqAt(uint8_t s) {
+      const uint16_t addr = SlotAddress(s);
+      return storage_.read(addr) | (storage_.read(addr + 1) << 8);
+    }
+
+    uint8_t OwnerOf(uint8_t s) const {
+      for (uint8_t id = 0; id < kRecords; id++) {
+        if (live_[id] == s) return id;
+      }
+      return kNone;
+    }
+
+    bool Holds(uint8_t s, const Payload& payload) {
+      const uint16_t addr = SlotAddress(s) + kPayloadOffset;
+      for (uint8_t i = 0; i < kPayloadSize; i++) {
+        if (storage_.read(addr + i) != payload[i]) return false;
+      }
+      return true;
+    }
+
+    bool ReadSlot(uint8_t s, uint16_t* seq, uint8_t* id) {
+      const uint16_t addr = SlotAddress(s);
+      uint8_t crc = kCrcInit;
+      for (uint8_t i = 0; i < kCrcOffset; i++) {
+        crc = _crc8_ccitt_update(crc, storage_.read(addr + i));
+      }
+      if (crc != storage_.read(addr + kCrcOffset)) return false;
+      *id = storage_.read(addr + kIdOffset);
+      if (*id >= kRecords) return false;
+      *seq = SeqAt(s);
+      return true;
+    }
+
+    void WriteSlot(uint8_t s, uint8_t id, const Payload& payload) {
+      uint8_t bytes[kSlotSize];
+      bytes[0] = seq_ & 0xFF;
+      bytes[1] = seq_ >> 8;
+      bytes[kIdOffset] = id;
+      for (uint8_t i = 0; i < kPayloadSize; i++) {
+        bytes[kPayloadOffset + i] = payload[i];
+      }
+      uint8_t crc = kCrcInit;
+      for (uint8_t i = 0; i < kCrcOffset; i++) {
+        crc = _crc8_ccitt_update(crc, bytes[i]);
+      }
+      bytes[kCrcOffset] = crc;
+      const uint16_t addr = SlotAddress(s);
+      for (uint8_t i = 0; i < kSlotSize; i++) {
+        storage_.update(addr + i, bytes[i]);
+      }
+      seq_++;
+    }
+};
+
+} // namespace eeprom_journal
@@ -0,0 +1,115 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+#include <stdio.h>
+#include <avr/pgmspace.h>
+#include <Arduino.h>
+
+// Bus traffic counters, per I2C device.
+//
+// Something has to call Record() for every transaction on the bus. On the
+// RedBoard that's the twi_writeTo/twi_readFrom wrappers in alarm_clock.cpp
+// (only in builds with ALARM_CLOCK_I2C_STATS); in the native build, the fake
+// devices call it themselves.
+namespace i2c_stats {
+
+enum Device : uint8_t {
+  kMp3,
+  kKeypad,
+  kRtc,
+  kLcd,
+  kOther,
+  kNumDevices,
+};
+
+struct Counters {
+  uint32_t transactions;
+  uint32_t bytes;
+  uint32_t micros;
+};
+
+struct Stats {
+  Counters devices[kNumDevices];
+  uint32_t loops;
+  unsigned long since_millis;
+};
+
+inline Stats& stats() {
+  static Stats s;
+  return s;
+}
+
+inline Device DeviceFor(uint8_t address) {
+  switch (address) {
+    case 0x37: return kMp3;
+    case 0x4B: return kKeypad;
+    case 0x69: return kRtc;
+    case 0x72: return kLcd;
+    default: return kOther;
+  }
+}
+
+// 0 for kOther.
+inline uint8_t AddressOf(Device device) {
+  static const uint8_t kAddresses[kNumDevices] PROGMEM = {
+    0x37, 0x4B, 0x69, 0x72, 0,
+  };
+  return pgm_read_byte(&kAddresses[device]);
+}
+
+// Copies the device's name for reports, at most 6 characters, into name.
+inline void GetName(Device device, char (&name)[7]) {
+  static const char kNames[kNumDevices][7] PROGMEM = {
+    "MP3", "Keypad", "RTC", "LCD", "other",
+  };
+  strcpy_P(name, kNames[device]);
+}
+
+inline void Record(uint8_t address, uint8_t bytes, uint32_t micros) {
+  Counters& c = stats().devices[DeviceFor(address)];
+  c.transactions++;
+  c.bytes += bytes;
+  c.micros += micros;
+}
+
+// Called once per main loop iteration, so the report can show the cost of
+// an average iteration.
+inline void CountLoop() {
+  stats().loops++;
+}
+
+inline void Reset() {
+  memset(&stats(), 0, sizeof(Stats));
+  stats().since_millis = millis();
+}
+
+// Prints a table like
+//   i2c: 1632 loops in 60000 ms
+//   dev    addr      tx   bytes      ms  tx/loop
+//   MP3    0x37       3       6       1     0.00
+//   ...
+inline void Report(Print& out) {
+  const Stats& s = stats();
+  char buf[56];
+  snprintf_P(buf, sizeof(buf), PSTR("i2c: %lu loops in %lu ms"),
+             static_cast<unsigned long>(s.loops),
+             static_cast<unsigned long>(millis() - s.since_millis));
+  out.println(buf);
+  out.println(F("dev    addr      tx   bytes      ms  tx/loop"));
+  for (uint8_t i = 0; i < kNumDevices; i++) {
+    const Counters& c = s.devices[i];
+    char name[7];
+    GetName(static_cast<Device>(i), name);
+    const unsigned long per_100_loops =
+        s.loops ? 100UL * c.transactions / s.loops : 0;
+    snprintf_P(buf, sizeof(buf), PSTR("%-6s 0x%02X %7lu %7lu %7lu %5lu.%02lu"),
+               name, AddressOf(static_cast<Device>(i)),
+               static_cast<unsigned long>(c.transactions),
+               static_cast<unsigned long>(c.bytes),
+               static_cast<unsigned long>(c.micros / 1000),
+               per_100_loops / 100, per_100_loops % 100);
+    out.println(buf);
+  }
+}
+
+} // namespace i2c_stats
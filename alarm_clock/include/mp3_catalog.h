@@ -0,0 +1,77 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+#include <Arduino.h>
+#include <string.h>
+
+namespace mp3_catalog {
+
+// What's on the MP3 trigger's SD card: how many songs, and the names of the
+// first kNames files, read once by scan() so that nothing else has to ask
+// the trigger. Files are numbered the way playFile() numbers them, from 1.
+//
+// The trigger only names the file it's playing, so scan() plays each of
+// them with the volume turned all the way down, and waits (up to
+// kPlayWaitMillis a file) for the trigger to say it's playing before asking
+// for the name. It's for setup(), and for when the trigger (and maybe a
+// different card) comes back after being disconnected. It stops whatever
+// was playing.
+//
+// Templated so that it works with MP3TRIGGER, or anything with the same
+// interface.
+template <class MP3, uint8_t kNames>
+class Catalog {
+  public:
+    // The trigger reports at most this much of a name.
+    static constexpr uint8_t kNameLength = 8;
+    // How long scan() waits for a file to start. A file that doesn't gets
+    // whatever name the trigger gives.
+    static constexpr unsigned long kPlayWaitMillis = 500;
+    static constexpr unsigned long kPlayPollMillis = 10;
+
+    explicit Catalog(MP3& mp3): mp3_(mp3) {}
+
+    // Leaves the trigger stopped, at the volume it was at.
+    void scan() {
+      count_ = 0;
+      if (!mp3_.hasCard()) return;
+      const uint16_t songs = mp3_.getSongCount();
+      count_ = songs > 255 ? 255 : songs;
+      const uint8_t volume = mp3_.getVolume();
+      mp3_.setVolume(0);
+      for (uint8_t file = 1; file <= count_ && file <= kNames; file++) {
+        mp3_.playFile(file);
+        waitForPlaying();
+        strncpy(names_[file - 1], mp3_.getSongName().c_str(), kNameLength);
+        names_[file - 1][kNameLength] = '\0';
+      }
+      mp3_.stop();
+      mp3_.setVolume(volume);
+    }
+
+    // 0 if there's no card, or the trigger didn't answer.
+    uint8_t count() const { return count_; }
+
+    bool has(uint8_t file) const { return file != 0 && file <= count_; }
+
+    // The name the trigger gave the file, or nullptr if it isn't one of the
+    // first kNames.
+    const char* name(uint8_t file) const {
+      if (!has(file) || file > kNames) return nullptr;
+      return names_[file - 1];
+    }
+
+  private:
+    void waitForPlaying() {
+      const unsigned long start = millis();
+      while (!mp3_.isPlaying() && millis() - start < kPlayWaitMillis) {
+        delay(kPlayPollMillis);
+      }
+    }
+
+    MP3& mp3_;
+    uint8_t count_ = 0;
+    char names_[kNames][kNameLength + 1];
+};
+
+} // namespace mp3_catalog
@@ -0,0 +1,153 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+#include <Arduino.h>
+
+namespace mp3_service {
+
+// Talks to an MP3 trigger on behalf of the rest of the program, so that
+// nothing else waits on the I2C bus for it.
+//
+// play(), stop(), setVolume() and setEq() only queue a command, and update
+// the cached state that playing(), volume() and eq() report, right away.
+// poll(), called periodically, sends at most one queued command per call.
+// A queued command replaces any queued command of the same kind that hasn't
+// been sent yet (a new play() replaces a pending stop(), several volume
+// steps become one setVolume), so the queue never holds more than three.
+//
+// While a file is playing, poll() asks the trigger whether it's still
+// playing once every status period, and calls the finished callback when it
+// isn't. Nothing is polled while nothing is playing.
+//
+// Templated so that it works with MP3TRIGGER, or anything with the same
+// interface.
+template <class MP3>
+class Service {
+  public:
+    typedef void (*Callback)(uint8_t file);
+
+    explicit Service(MP3& mp3): mp3_(mp3) {}
+
+    // Reads the volume and EQ from the trigger, once, and drops anything
+    // queued before then.
+    void begin(unsigned long status_period_millis, Callback on_finished) {
+      length_ = 0;
+      status_period_ = status_period_millis;
+      on_finished_ = on_finished;
+      volume_ = mp3_.getVolume();
+      eq_ = mp3_.getEQ();
+    }
+
+    void play(uint8_t file) {
+      Queue(kPlay, file);
+      file_ = file;
+    }
+
+    void stop() {
+      Queue(kStop, 0);
+      file_ = 0;
+    }
+
+    void setVolume(uint8_t volume) {
+      Queue(kVolume, volume);
+      volume_ = volume;
+    }
+
+    void setEq(uint8_t eq) {
+      Queue(kEq, eq);
+      eq_ = eq;
+    }
+
+    // Queues the volume, the EQ, and the file that should be playing, for a
+    // trigger that has lost them (after it was reset, say).
+    void restore() {
+      Queue(kVolume, volume_);
+      Queue(kEq, eq_);
+      Queue(file_ != 0 ? kPlay : kStop, file_);
+    }
+
+    bool playing() const { return file_ != 0; }
+    // The file that is playing, or 0.
+    uint8_t file() const { return file_; }
+    uint8_t volume() const { return volume_; }
+    uint8_t eq() const { return eq_; }
+    // Whether there are commands that poll() hasn't sent yet.
+    bool pending() const { return length_ > 0; }
+
+    void poll() {
+      const unsigned long now = millis();
+      if (length_ > 0) {
+        Send(queue_[0]);
+        length_--;
+        for (uint8_t i = 0; i < length_; i++) queue_[i] = queue_[i + 1];
+        // Give the trigger time to start before asking whether it's playing.
+        last_status_ = now;
+        return;
+      }
+      if (file_ == 0 || now - last_status_ < status_period_) return;
+      last_status_ = now;
+      if (!mp3_.isPlaying()) {
+        const uint8_t file = file_;
+        file_ = 0;
+        if (on_finished_ != nullptr) on_finished_(file);
+      }
+    }
+
+  private:
+    enum Op : uint8_t {
+      kPlay,
+      kStop,
+      kVolume,
+      kEq,
+    };
+
+    struct Command {
+      Op op;
+      uint8_t arg;
+    };
+
+    // Play and stop are the same kind of command, since only the last of
+    // them matters.
+    static Op Kind(Op op) {
+      return op == kStop ? kPlay : op;
+    }
+
+    void Queue(Op op, uint8_t arg) {
+      for (uint8_t i = 0; i < length_; i++) {
+        if (Kind(queue_[i].op) == Kind(op)) {
+          queue_[i] = {op, arg};
+          return;
+        }
+      }
+      queue_[length_++] = {op, arg};
+    }
+
+    void Send(const Command& c) {
+      switch (c.op) {
+        case kPlay:
+          mp3_.playFile(c.arg);
+          break;
+        case kStop:
+          mp3_.stop();
+          break;
+        case kVolume:
+          mp3_.setVolume(c.arg);
+          break;
+        case kEq:
+          mp3_.setEQ(c.arg);
+          break;
+      }
+    }
+
+    MP3& mp3_;
+    Command queue_[3];
+    uint8_t length_ = 0;
+    unsigned long status_period_ = 1000;
+    unsigned long last_status_ = 0;
+    Callback on_finished_ = nullptr;
+    uint8_t file_ = 0;
+    uint8_t volume_ = 0;
+    uint8_t eq_ = 0;
+};
+
+} // namespace mp3_service
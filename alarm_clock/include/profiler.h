@@ -0,0 +1,177 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include <Arduino.h>
+#include "ram_monitor.h"
+
+// Time spent in each phase of the main loop, measured with micros().
+//
+// Put a Scope at the top of the code to be measured:
+//
+//   void RefreshDisplay() {
+//     profiler::Scope scope(profiler::kDisplay);
+//     ...
+//   }
+//
+// Each phase keeps its run count, min, max and total, and a histogram with
+// one bucket per power of two: bucket 0 counts runs under 128 us, bucket i
+// counts runs of 2^(i+6) to 2^(i+7) us, and the last bucket counts everything
+// from 32.768 ms up. That is 36 bytes of RAM per phase, so it's only compiled
+// in with ALARM_CLOCK_PROFILE (the uno_instrumented and native builds).
+// Without it, Scope is empty and the rest of this header isn't there at all.
+//
+// On the RedBoard, micros() counts in steps of 4 us, and anything measured
+// includes the interrupts that ran in the meantime.
+//
+// With ALARM_CLOCK_STACK_DEPTH (the native_stack build), it also keeps the
+// most stack each phase has used, measured by ram_monitor::Depth, in bytes.
+namespace profiler {
+
+enum Phase : uint8_t {
+  // One pass of loop(), not counting the time it spends asleep.
+  kLoop,
+  // The scheduler's tasks.
+  kClock,
+  kSound,
+  kKeypad,
+  kStateMachine,
+  kDisplay,
+  kConsole,
+  // Handling a key while the menu is open.
+  kMenu,
+  // Writing the settings to the EEPROM.
+  kSave,
+  kNumPhases,
+};
+
+#ifdef ALARM_CLOCK_PROFILE
+
+constexpr uint8_t kNumBuckets = 10;
+
+struct Counters {
+  uint32_t runs;
+  uint32_t min_micros;
+  uint32_t max_micros;
+  // Wraps after 71 minutes of solid work, which nothing here comes near.
+  uint32_t total_micros;
+  // Saturate rather than wrap.
+  uint16_t buckets[kNumBuckets];
+#ifdef ALARM_CLOCK_STACK_DEPTH
+  uint32_t max_stack;
+#endif
+};
+
+struct Stats {
+  Counters phases[kNumPhases];
+  unsigned long since_millis;
+};
+
+inline Stats& stats() {
+  static Stats s;
+  return s;
+}
+
+inline uint8_t BucketFor(uint32_t micros) {
+  uint8_t bucket = 0;
+  for (micros >>= 7; micros != 0 && bucket < kNumBuckets - 1; micros >>= 1) {
+    bucket++;
+  }
+  return bucket;
+}
+
+inline void Record(Phase phase, uint32_t micros) {
+  Counters& c = stats().phases[phase];
+  if (c.runs == 0 || micros < c.min_micros) c.min_micros = micros;
+  if (micros > c.max_micros) c.max_micros = micros;
+  c.runs++;
+  c.total_micros += micros;
+  uint16_t& bucket = c.buckets[BucketFor(micros)];
+  if (bucket != 0xFFFF) bucket++;
+}
+
+class Scope {
+  public:
+    explicit Scope(Phase phase) : phase_(phase), start_(micros()) {}
+    ~Scope() {
+      Record(phase_, micros() - start_);
+#ifdef ALARM_CLOCK_STACK_DEPTH
+      uint32_t& max_stack = stats().phases[phase_].max_stack;
+      const uint32_t stack = depth_.peak();
+      if (stack > max_stack) max_stack = stack;
+#endif
+    }
+
+  private:
+#ifdef ALARM_CLOCK_STACK_DEPTH
+    ram_monitor::Depth depth_;
+#endif
+    const Phase phase_;
+    const unsigned long start_;
+};
+
+inline void Reset() {
+  memset(&stats(), 0, sizeof(Stats));
+  stats().since_millis = millis();
+}
+
+// Prints a table like
+//   profile: 90952 ms
+//   phase     runs    min    avg    max  <128  <256  <512   <1m   <2m ...
+//   loop       906      0   1635 225100   884     0     5     0     2 ...
+//   clock        2   1030   1175   1320     0     0     0     0     2 ...
+// with times in microseconds, and the histogram's buckets labelled by their
+// upper bounds (1m = 1.024 ms, and so on). The native_stack build adds a
+// column for the stack.
+inline void Report(Print& out) {
+  static const char kNames[kNumPhases][7] PROGMEM = {
+    "loop", "clock", "sound", "keypad", "state", "lcd", "serial", "menu",
+    "save",
+  };
+  const Stats& s = stats();
+  char buf[64];
+  snprintf_P(buf, sizeof(buf), PSTR("profile: %lu ms"),
+             static_cast<unsigned long>(millis() - s.since_millis));
+  out.println(buf);
+  out.println(F("phase     runs    min    avg    max"
+                "  <128  <256  <512   <1m   <2m   <4m   <8m  <16m  <32m"
+                "  more"
+#ifdef ALARM_CLOCK_STACK_DEPTH
+                "  stack"
+#endif
+                ));
+  for (uint8_t i = 0; i < kNumPhases; i++) {
+    const Counters& c = s.phases[i];
+    char name[7];
+    strcpy_P(name, kNames[i]);
+    snprintf_P(buf, sizeof(buf), PSTR("%-6s %7lu %6lu %6lu %6lu"),
+               name, static_cast<unsigned long>(c.runs),
+               static_cast<unsigned long>(c.min_micros),
+               static_cast<unsigned long>(c.runs ? c.total_micros / c.runs : 0),
+               static_cast<unsigned long>(c.max_micros));
+    out.print(buf);
+    for (uint8_t b = 0; b < kNumBuckets; b++) {
+      snprintf_P(buf, sizeof(buf), PSTR(" %5u"), c.buckets[b]);
+      out.print(buf);
+    }
+#ifdef ALARM_CLOCK_STACK_DEPTH
+    snprintf_P(buf, sizeof(buf), PSTR(" %6lu"),
+               static_cast<unsigned long>(c.max_stack));
+    out.print(buf);
+#endif
+    out.println();
+  }
+}
+
+#else
+
+class Scope {
+  public:
+    explicit Scope(Phase) {}
+};
+
+#endif // ALARM_CLOCK_PROFILE
+
+} // namespace profiler
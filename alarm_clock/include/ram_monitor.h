@@ -0,0 +1,197 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include <Arduino.h>
+
+// How close the stack has come to running into the heap.
+//
+// On the ATmega328, the stack grows down from the top of its 2 KB of RAM,
+// and the heap grows up from the end of the static variables. If they ever
+// meet, the program goes wrong in ways that look random, like a reset at
+// 6 am. So before anything else runs, everything between them is painted
+// with kPaint (see the .init3 code in alarm_clock.cpp), and the bytes that
+// still hold it later on are ones the stack has never reached. Sample(),
+// called periodically, keeps the smallest free RAM seen between the heap and
+// the stack as it is then, and NeverUsed() counts the painted bytes left:
+// the margin at the stack's deepest point since boot, however briefly it
+// was there.
+//
+// The native build has no such budget to measure. Instead, in the
+// native_stack build, Depth measures how much stack a piece of code uses, by
+// painting below it on the way in and looking for the deepest byte that
+// changed on the way out, and profiler::Scope reports it for each phase of
+// the loop. Host frames are bigger than the ATmega's, so those numbers are
+// for comparing one version of the code against another, not against the
+// 2 KB.
+
+#ifdef ARDUINO_ARCH_AVR
+extern "C" {
+// From the linker and avr-libc's malloc respectively.
+extern uint8_t __heap_start;
+extern char* __brkval;
+}
+#endif
+
+namespace ram_monitor {
+
+constexpr uint8_t kPaint = 0xC5;
+
+#ifdef ARDUINO_ARCH_AVR
+
+constexpr bool kMeasured = true;
+
+inline const uint8_t* HeapEnd() {
+  return __brkval != nullptr ? reinterpret_cast<const uint8_t*>(__brkval)
+                             : &__heap_start;
+}
+
+// Between the heap and the stack, right now.
+inline uint16_t FreeNow() {
+  const uint8_t here = 0;
+  return &here - HeapEnd();
+}
+
+inline uint16_t StaticSize() {
+  return &__heap_start - reinterpret_cast<const uint8_t*>(RAMSTART);
+}
+
+inline uint16_t HeapSize() {
+  return HeapEnd() - &__heap_start;
+}
+
+// The painted bytes just past the heap, which the stack has never reached.
+inline uint16_t NeverUsed() {
+  const uint8_t here = 0;
+  const uint8_t* p = HeapEnd();
+  while (p < &here && *p == kPaint) p++;
+  return p - HeapEnd();
+}
+
+#else
+
+constexpr bool kMeasured = false;
+
+inline uint16_t FreeNow() { return 0; }
+inline uint16_t StaticSize() { return 0; }
+inline uint16_t HeapSize() { return 0; }
+inline uint16_t NeverUsed() { return 0; }
+
+#ifdef ALARM_CLOCK_STACK_DEPTH
+
+// How far below the outermost Depth the stack is watched, and how close to
+// the current frame painting stops: Paint() needs some stack of its own to
+// run. Usage is only measured to within kMargin.
+constexpr size_t kWindow = 16384;
+constexpr size_t kMargin = 512;
+
+// Painting below the stack pointer is nothing C++ defines. It works with GCC
+// on the Linux and macOS hosts this runs on, but it also costs a scan of the
+// window for every Depth, so it's only in the native_stack build.
+//
+// The outermost Depth (the profiler's loop phase) paints the whole window
+// once per pass. The ones inside it only repaint what has been used since,
+// so that a phase isn't charged for whatever ran before it.
+class Depth {
+  public:
+    Depth() : top_(static_cast<uint8_t*>(__builtin_frame_address(0))) {
+      if (nesting()++ == 0) {
+        bottom() = top_ - kWindow;
+        Paint(bottom(), top_ - kMargin);
+      } else {
+        // What was used so far belongs to the Depth around this one.
+        uint8_t* const used = Scan(top_);
+        if (used < lowest()) lowest() = used;
+        Paint(used, top_ - kMargin);
+      }
+      outer_lowest_ = lowest();
+      lowest() = top_;
+    }
+
+    ~Depth() { nesting()--; }
+
+    // How many bytes below where it was constructed the stack has been,
+    // counting any Depth inside this one, which paint over what this one
+    // would otherwise have seen.
+    size_t peak() {
+      uint8_t* low = Scan(top_);
+      if (lowest() < low) low = lowest();
+      lowest() = outer_lowest_ < low ? outer_lowest_ : low;
+      return top_ - low;
+    }
+
+  private:
+    // The deepest that the Depths inside the innermost one still being
+    // measured have seen.
+    static uint8_t*& lowest() {
+      static uint8_t* l = reinterpret_cast<uint8_t*>(UINTPTR_MAX);
+      return l;
+    }
+
+    static uint8_t*& bottom() {
+      static uint8_t* b = nullptr;
+      return b;
+    }
+
+    static uint8_t& nesting() {
+      static uint8_t n = 0;
+      return n;
+    }
+
+    __attribute__((noinline)) static void Paint(uint8_t* from, uint8_t* to) {
+      if (from < to) memset(from, kPaint, to - from);
+    }
+
+    // The first byte from the bottom of the window up that isn't paint,
+    // checked a word at a time for speed.
+    __attribute__((noinline)) static uint8_t* Scan(uint8_t* top) {
+      uint64_t paint;
+      memset(&paint, kPaint, sizeof(paint));
+      uint8_t* p = bottom();
+      uint8_t* const end = top - kMargin;
+      while (p + sizeof(paint) <= end &&
+             memcmp(p, &paint, sizeof(paint)) == 0) {
+        p += sizeof(paint);
+      }
+      while (p < end && *p == kPaint) p++;
+      return p;
+    }
+
+    uint8_t* const top_;
+    uint8_t* outer_lowest_;
+};
+
+#endif // ALARM_CLOCK_STACK_DEPTH
+
+#endif // ARDUINO_ARCH_AVR
+
+inline uint16_t& min_free() {
+  static uint16_t m = 0xFFFF;
+  return m;
+}
+
+inline void Sample() {
+  const uint16_t free = FreeNow();
+  if (free < min_free()) min_free() = free;
+}
+
+// Prints a line like
+//   ram: 1302 static, 22 heap, 595 free, 571 min, 402 never used
+// in bytes, where min is the least that Sample() has seen free.
+inline void Report(Print& out) {
+  if (!kMeasured) {
+    out.println(F("ram: only measured on the ATmega."));
+    return;
+  }
+  char buf[64];
+  snprintf_P(buf, sizeof(buf),
+             PSTR("ram: %u static, %u heap, %u free, %u min, %u never used"),
+             StaticSize(), HeapSize(), FreeNow(), min_free(), NeverUsed());
+  out.println(buf);
+}
+
+} // namespace ram_monitor
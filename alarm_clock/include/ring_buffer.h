@@ -0,0 +1,55 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+#include <stdint.h>
+
+namespace ring_buffer {
+
+// A fixed-size FIFO queue.
+//
+// Safe to use between one interrupt handler that pushes and the main program
+// that pops (or the other way around) without disabling interrupts: each side
+// only writes its own index, N is at most 255 so that the indices are written
+// atomically, and an item is only copied while the other side can't see its
+// slot.
+template <class T, uint8_t N>
+class RingBuffer {
+  public:
+    bool empty() const { return head_ == tail_; }
+    bool full() const { return Next(tail_) == head_; }
+
+    // Returns false, and drops t, if the buffer is full.
+    bool push(const T& t) {
+      const uint8_t next = Next(tail_);
+      if (next == head_) return false;
+      items_[tail_] = t;
+      Barrier();
+      tail_ = next;
+      return true;
+    }
+
+    // Returns false if the buffer is empty.
+    bool pop(T* t) {
+      if (empty()) return false;
+      *t = items_[head_];
+      Barrier();
+      head_ = Next(head_);
+      return true;
+    }
+
+  private:
+    // Keeps the compiler from moving the copy of an item past the index
+    // update that hands its slot to the other side.
+    static void Barrier() { __asm__ __volatile__("" ::: "memory"); }
+
+    static uint8_t Next(uint8_t i) {
+      return i + 1 == N + 1 ? 0 : i + 1;
+    }
+
+    // One more than N, so that full and empty can be told apart.
+    T items_[N + 1];
+    volatile uint8_t head_ = 0;
+    volatile uint8_t tail_ = 0;
+};
+
+} // namespace ring_buffer
@@ -0,0 +1,97 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+#include <Arduino.h>
+#include <avr/sleep.h>
+
+namespace scheduler {
+
+// A cooperative scheduler for a fixed set of periodic tasks.
+//
+// Each task runs every `period` milliseconds, and also as soon as possible
+// after someone calls Wake() on it. A task with a period of kNever only runs
+// when woken. Tasks run to completion, in order of their ids, so a task that
+// consumes another task's results should have the higher id.
+//
+// The main loop calls RunDue() and then Idle(). Any loop that has to wait for
+// something should do the same, so that every task keeps running at its own
+// rate no matter who is waiting.
+template <uint8_t N>
+class Scheduler {
+  public:
+    static constexpr unsigned long kNever = 0xFFFFFFFFUL;
+
+    void Add(uint8_t id, void (*run)(), unsigned long period_millis) {
+      Task& t = tasks_[id];
+      t.run = run;
+      t.period = period_millis;
+      t.last_run = millis();
+      t.woken = true;
+      t.enabled = true;
+    }
+
+    // Safe to call from an interrupt handler.
+    void Wake(uint8_t id) {
+      tasks_[id].woken = true;
+    }
+
+    // A disabled task doesn't run, even when woken. Wakeups that arrive while
+    // it is disabled are remembered for when it is enabled again.
+    void Enable(uint8_t id, bool enabled) {
+      tasks_[id].enabled = enabled;
+    }
+
+    // Runs every task that is due, once.
+    void RunDue() {
+      for (uint8_t i = 0; i < N; i++) {
+        Task& t = tasks_[i];
+        const unsigned long now = millis();
+        if (!Due(t, now)) continue;
+        t.woken = false;
+        t.last_run = now;
+        t.run();
+      }
+    }
+
+    // Changes how long after its last run a task is due again. A task can
+    // call this while it runs, to pick when it runs next.
+    void SetPeriod(uint8_t id, unsigned long period_millis) {
+      tasks_[id].period = period_millis;
+    }
+
+    // Sleeps until a task is due. Idle sleep keeps the timers running, and
+    // any interrupt ends it, so the Timer0 interrupt behind millis() checks
+    // again every millisecond, and a Wake() from an interrupt handler ends
+    // the wait within a millisecond. That also means the CPU only ever
+    // sleeps between Timer0 ticks, about 1 ms at a time, so this saves
+    // what the CPU would spend spinning in delay(), not much more.
+    void Idle() {
+      set_sleep_mode(SLEEP_MODE_IDLE);
+      while (true) {
+        const unsigned long now = millis();
+        for (uint8_t i = 0; i < N; i++) {
+          if (Due(tasks_[i], now)) return;
+        }
+        sleep_mode();
+      }
+    }
+
+  private:
+    struct Task {
+      void (*run)() = nullptr;
+      unsigned long period = kNever;
+      unsigned long last_run = 0;
+      volatile bool woken = false;
+      bool enabled = false;
+    };
+
+    static bool Due(const Task& t, unsigned long now) {
+      if (t.run == nullptr || !t.enabled) return false;
+      if (t.woken) return true;
+      return t.period != kNever && now - t.last_run >= t.period;
+    }
+
+    Task tasks_[N];
+};
+
+} // namespace scheduler
@@ -0,0 +1,158 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+#include <string.h>
+#include <Print.h>
+
+namespace shadow_lcd {
+
+// A copy, in RAM, of what should be on the LCD.
+//
+// Code that draws the screen draws into the Buffer instead of the LCD, using
+// the same setCursor/print/writeChar interface, and then calls flush() once the
+// picture is complete. flush() compares the picture against what the LCD is
+// known to be showing, and sends only the cells that changed: for each row, a
+// single write covering the first through the last changed cell, preceded by a
+// setCursor only if the LCD's cursor isn't already there. Since a SerLCD
+// setCursor is a separate I2C transaction followed by a 50 ms settling delay,
+// rewriting a few unchanged cells in between is far cheaper than skipping
+// them. Redrawing an unchanged picture costs no bus traffic at all.
+//
+// Templated so that it works with both SerLCD and LiquidCrystal
+// (and any other class that implements the same interface).
+template <class LCD, uint8_t COLS = 16, uint8_t ROWS = 2>
+class Buffer : public Print {
+  private:
+    static constexpr uint8_t kUnknown = 0xFF;
+
+    LCD& lcd_;
+    uint8_t cells_[ROWS][COLS];
+    uint8_t shown_[ROWS][COLS];
+    // False until the first flush, and after invalidate(): we don't know what
+    // the LCD shows, so every cell is sent.
+    bool shown_valid_ = false;
+    uint8_t column_ = 0;
+    uint8_t row_ = 0;
+    uint8_t lcd_column_ = kUnknown;
+    uint8_t lcd_row_ = kUnknown;
+    bool blink_ = false;
+    bool lcd_blink_ = false;
+    bool backlight_valid_ = false;
+    uint8_t backlight_[3];
+
+    void LcdSetCursor(uint8_t col, uint8_t row) {
+      if (col == lcd_column_ && row == lcd_row_) return;
+      lcd_.setCursor(col, row);
+      lcd_column_ = col;
+      lcd_row_ = row;
+    }
+
+  public:
+    explicit Buffer(LCD& lcd): lcd_(lcd) {
+      memset(cells_, ' ', sizeof(cells_));
+    }
+
+    // Forget what the LCD is showing, e.g. after it has been reset. The next
+    // flush() repaints everything.
+    void invalidate() {
+      shown_valid_ = false;
+      lcd_column_ = kUnknown;
+      lcd_row_ = kUnknown;
+      backlight_valid_ = false;
+    }
+
+    // Blanks the picture. Unlike SerLCD::clear(), this doesn't touch the LCD.
+    void clear() {
+      memset(cells_, ' ', sizeof(cells_));
+      column_ = 0;
+      row_ = 0;
+    }
+
+    void setCursor(uint8_t col, uint8_t row) {
+      column_ = col;
+      row_ = row;
+    }
+
+    // Shows custom character `location` (0-7) at the cursor.
+    void writeChar(uint8_t location) {
+      write(static_cast<uint8_t>(location & 0x7));
+    }
+
+    // '\r' and '\n' move the cursor as println() expects. Text past the end of
+    // a row is dropped.
+    size_t write(uint8_t c) override {
+      if (c == '\r') {
+        column_ = 0;
+        return 1;
+      }
+      if (c == '\n') {
+        column_ = 0;
+        row_++;
+        return 1;
+      }
+      if (column_ < COLS && row_ < ROWS) {
+        cells_[row_][column_] = c;
+      }
+      column_++;
+      return 1;
+    }
+
+    size_t write(const uint8_t* buffer, size_t size) override {
+      for (size_t i = 0; i < size; i++) write(buffer[i]);
+      return size;
+    }
+
+    using Print::write;
+
+    // The blinking cursor is shown at the Buffer's cursor position as of the
+    // next flush().
+    void blink() { blink_ = true; }
+    void noBlink() { blink_ = false; }
+
+    // Sent right away, but only if the color changed.
+    void setFastBacklight(uint8_t r, uint8_t g, uint8_t b) {
+      if (backlight_valid_ && backlight_[0] == r && backlight_[1] == g &&
+          backlight_[2] == b) {
+        return;
+      }
+      lcd_.setFastBacklight(r, g, b);
+      backlight_[0] = r;
+      backlight_[1] = g;
+      backlight_[2] = b;
+      backlight_valid_ = true;
+    }
+
+    void flush() override {
+      if (lcd_blink_ && !blink_) {
+        lcd_.noBlink();
+        lcd_blink_ = false;
+      }
+      for (uint8_t row = 0; row < ROWS; row++) {
+        uint8_t first = 0;
+        uint8_t last = COLS - 1;
+        if (shown_valid_) {
+          while (first < COLS && cells_[row][first] == shown_[row][first]) {
+            first++;
+          }
+          if (first == COLS) continue;
+          while (cells_[row][last] == shown_[row][last]) last--;
+        }
+        LcdSetCursor(first, row);
+        lcd_.write(&cells_[row][first], last - first + 1);
+        memcpy(&shown_[row][first], &cells_[row][first], last - first + 1);
+        // We don't rely on the LCD to wrap to the next row correctly.
+        lcd_column_ = last + 1 < COLS ? last + 1 : kUnknown;
+      }
+      shown_valid_ = true;
+      if (blink_) {
+        LcdSetCursor(column_ < COLS ? column_ : COLS - 1,
+                     row_ < ROWS ? row_ : ROWS - 1);
+        if (!lcd_blink_) {
+          lcd_.blink();
+          lcd_blink_ = true;
+        }
+      }
+    }
+};
+
+} // namespace shadow_lcd
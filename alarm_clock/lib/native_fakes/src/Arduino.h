@@ -0,0 +1,91 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+// The parts of the Arduino core that the firmware and the SparkFun libraries
+// use, implemented on top of the virtual clock and pins in native_fakes.h.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "avr/interrupt.h"
+#include "avr/io.h"
+#include "avr/pgmspace.h"
+#include "Print.h"
+#include "WString.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+// The Uno's I2C pins, A4 and A5.
+static const uint8_t SDA = 18;
+static const uint8_t SCL = 19;
+
+#define NOT_AN_INTERRUPT -1
+// Like the Uno: INT0 is on pin 2 and INT1 is on pin 3.
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : NOT_AN_INTERRUPT))
+// Pin change interrupts, from the Uno's pins_arduino.h.
+#define digitalPinToPCICR(p) (((p) >= 0 && (p) <= 21) ? (&PCICR) : nullptr)
+#define digitalPinToPCICRbit(p) (((p) <= 7) ? 2 : (((p) <= 13) ? 0 : 1))
+#define digitalPinToPCMSK(p) \
+  (((p) <= 7) ? (&PCMSK2) : (((p) <= 13) ? (&PCMSK0) : (&PCMSK1)))
+#define digitalPinToPCMSKbit(p) \
+  (((p) <= 7) ? (p) : (((p) <= 13) ? ((p) - 8) : ((p) - 14)))
+
+#define bit(b) (1UL << (b))
+#define bitRead(value, b) (((value) >> (b)) & 0x01)
+
+#define interrupts()
+#define noInterrupts()
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t val);
+void attachInterrupt(uint8_t interrupt, void (*isr)(), int mode);
+void detachInterrupt(uint8_t interrupt);
+
+// avr-libc's stdio extensions, which the firmware uses to fprintf to a Print.
+FILE* fdevopen(int (*put)(char, FILE*), int (*get)(FILE*));
+void fdev_set_udata(FILE* f, void* u);
+void* fdev_get_udata(FILE* f);
+
+// The USB serial port is the host's stdin and stdout.
+class HardwareSerial : public Print {
+  public:
+    void begin(unsigned long baud);
+    void end() {}
+    int available();
+    int read();
+    int peek();
+    void flush() override;
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    explicit operator bool() const { return true; }
+
+  private:
+    int peeked_ = -1;
+};
+
+extern HardwareSerial Serial;
+
+void setup();
+void loop();
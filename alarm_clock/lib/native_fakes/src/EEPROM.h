@@ -0,0 +1,36 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+// The ATmega328's 1 KB EEPROM. Like the real thing, each byte actually
+// written costs about 3.3 ms, and update()/put() skip bytes that are
+// unchanged.
+
+#include "Arduino.h"
+
+class EEPROMClass {
+  public:
+    static constexpr uint16_t kLength = 1024;
+
+    uint8_t read(int idx);
+    void write(int idx, uint8_t val);
+    void update(int idx, uint8_t val) {
+      if (read(idx) != val) write(idx, val);
+    }
+    uint16_t length() const { return kLength; }
+
+    template <typename T>
+    T& get(int idx, T& t) {
+      uint8_t* p = reinterpret_cast<uint8_t*>(&t);
+      for (size_t i = 0; i < sizeof(T); i++) p[i] = read(idx + i);
+      return t;
+    }
+
+    template <typename T>
+    const T& put(int idx, const T& t) {
+      const uint8_t* p = reinterpret_cast<const uint8_t*>(&t);
+      for (size_t i = 0; i < sizeof(T); i++) update(idx + i, p[i]);
+      return t;
+    }
+};
+
+extern EEPROMClass EEPROM;
@@ -0,0 +1,59 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+// A faithful copy of the interface of the Arduino core's Print class, so that
+// the fakes, double_high_digits::Writer and the firmware see the same
+// overloads (and the same per-character write() calls) as on the RedBoard.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "WString.h"
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class Print {
+  public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* str) {
+      if (str == nullptr) return 0;
+      return write(reinterpret_cast<const uint8_t*>(str), strlen(str));
+    }
+    size_t write(const char* buffer, size_t size) {
+      return write(reinterpret_cast<const uint8_t*>(buffer), size);
+    }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const __FlashStringHelper*);
+    size_t print(const String&);
+    size_t print(const char[]);
+    size_t print(char);
+    size_t print(unsigned char, int = DEC);
+    size_t print(int, int = DEC);
+    size_t print(unsigned int, int = DEC);
+    size_t print(long, int = DEC);
+    size_t print(unsigned long, int = DEC);
+    size_t print(double, int = 2);
+
+    size_t println(const __FlashStringHelper*);
+    size_t println(const String&);
+    size_t println(const char[]);
+    size_t println(char);
+    size_t println(unsigned char, int = DEC);
+    size_t println(int, int = DEC);
+    size_t println(unsigned int, int = DEC);
+    size_t println(long, int = DEC);
+    size_t println(unsigned long, int = DEC);
+    size_t println(double, int = 2);
+    size_t println();
+
+  private:
+    size_t printNumber(unsigned long, uint8_t);
+};
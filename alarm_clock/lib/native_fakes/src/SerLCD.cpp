@@ -0,0 +1,142 @@
+// vim: sts=2 sw=2 fdm=syntax
+#include "SerLCD.h"
+
+#include "native_fakes.h"
+
+// Mirrors the library's two kinds of commands: "setting" commands prefixed by
+// '|' wait 10 ms for the display to settle, and "special" (HD44780) commands
+// prefixed by 254 wait 50 ms.
+
+SerLCD::SerLCD() {
+  memset(screen_, ' ', sizeof(screen_));
+  native_fakes::RegisterDevice(this);
+}
+
+void SerLCD::begin(TwoWire& wirePort) {
+  begin(wirePort, DISPLAY_ADDRESS1);
+}
+
+void SerLCD::begin(TwoWire& wirePort, byte i2c_addr) {
+  (void)wirePort;
+  address_ = i2c_addr;
+  // display(), clear() and the entry mode setup that the library sends.
+  native_fakes::BusTransaction(address_, 6);
+  delay(50);
+}
+
+void SerLCD::command(byte command) {
+  (void)command;
+  native_fakes::BusTransaction(address_, 2);
+  delay(10);
+}
+
+void SerLCD::specialCommand(byte command) {
+  (void)command;
+  native_fakes::BusTransaction(address_, 2);
+  delay(50);
+}
+
+void SerLCD::clear() {
+  command('-');
+  delay(10);
+  memset(screen_, ' ', sizeof(screen_));
+  col_ = 0;
+  row_ = 0;
+}
+
+void SerLCD::home() {
+  specialCommand(0x02);
+  col_ = 0;
+  row_ = 0;
+}
+
+void SerLCD::setCursor(byte col, byte row) {
+  specialCommand(0x80 | (col + (row ? 0x40 : 0)));
+  col_ = col < 16 ? col : 15;
+  row_ = row < 2 ? row : 1;
+}
+
+void SerLCD::createChar(byte location, byte charmap[]) {
+  (void)location;
+  (void)charmap;
+  native_fakes::BusTransaction(address_, 10);
+  delay(50);
+}
+
+void SerLCD::writeChar(byte location) {
+  command(35 + (location & 0x7));
+  Put(location & 0x7);
+}
+
+void SerLCD::Put(uint8_t c) {
+  if (c == '\r') {
+    col_ = 0;
+    return;
+  }
+  if (c == '\n') {
+    col_ = 0;
+    row_ = (row_ + 1) % 2;
+    return;
+  }
+  screen_[row_][col_] = c;
+  if (++col_ == 16) {
+    col_ = 0;
+    row_ = (row_ + 1) % 2;
+  }
+}
+
+size_t SerLCD::write(uint8_t b) {
+  native_fakes::BusTransaction(address_, 1);
+  Put(b);
+  delay(10);
+  return 1;
+}
+
+size_t SerLCD::write(const uint8_t* buffer, size_t size) {
+  native_fakes::BusTransaction(address_, size);
+  for (size_t i = 0; i < size; i++) Put(buffer[i]);
+  delay(10);
+  return size;
+}
+
+size_t SerLCD::write(const char* str) {
+  if (str == nullptr) return 0;
+  return write(reinterpret_cast<const uint8_t*>(str), strlen(str));
+}
+
+void SerLCD::noDisplay() { specialCommand(0x08); }
+void SerLCD::display() { specialCommand(0x0C); }
+void SerLCD::noCursor() { specialCommand(0x0C); }
+void SerLCD::cursor() { specialCommand(0x0E); }
+
+void SerLCD::noBlink() {
+  specialCommand(0x0C);
+  blink_ = false;
+}
+
+void SerLCD::blink() {
+  specialCommand(0x0D);
+  blink_ = true;
+}
+
+void SerLCD::setBacklight(byte r, byte g, byte b) {
+  (void)r;
+  (void)g;
+  (void)b;
+  // The slow path sends three separate setting commands.
+  for (int i = 0; i < 3; i++) command(128);
+}
+
+void SerLCD::setFastBacklight(byte r, byte g, byte b) {
+  (void)r;
+  (void)g;
+  (void)b;
+  native_fakes::BusTransaction(address_, 5);
+  delay(10);
+}
+
+void SerLCD::setContrast(byte new_val) {
+  (void)new_val;
+  native_fakes::BusTransaction(address_, 3);
+  delay(10);
+}
@@ -0,0 +1,55 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+// Fake of the SparkFun SerLCD library, I2C flavor only. The screen contents
+// are kept so the host can look at them, and each call costs the same bus
+// transaction and the same settling delay() that the real library spends.
+
+#include "Arduino.h"
+#include "Wire.h"
+
+#define DISPLAY_ADDRESS1 0x72
+#define MAX_ROWS 4
+#define MAX_COLUMNS 20
+
+class SerLCD : public Print {
+  public:
+    SerLCD();
+
+    void begin(TwoWire& wirePort);
+    void begin(TwoWire& wirePort, byte i2c_addr);
+    void clear();
+    void home();
+    void setCursor(byte col, byte row);
+    void createChar(byte location, byte charmap[]);
+    void writeChar(byte location);
+    size_t write(uint8_t b) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    virtual size_t write(const char* str);
+    void noDisplay();
+    void display();
+    void noCursor();
+    void cursor();
+    void noBlink();
+    void blink();
+    void setBacklight(byte r, byte g, byte b);
+    void setFastBacklight(byte r, byte g, byte b);
+    void setContrast(byte new_val);
+    void command(byte command);
+    void specialCommand(byte command);
+
+    // Host-side accessors.
+    uint8_t cell(uint8_t col, uint8_t row) const { return screen_[row][col]; }
+    bool blinking() const { return blink_; }
+    uint8_t cursorColumn() const { return col_; }
+    uint8_t cursorRow() const { return row_; }
+
+  private:
+    void Put(uint8_t c);
+
+    uint8_t address_ = DISPLAY_ADDRESS1;
+    uint8_t screen_[2][16];
+    uint8_t col_ = 0;
+    uint8_t row_ = 0;
+    bool blink_ = false;
+};
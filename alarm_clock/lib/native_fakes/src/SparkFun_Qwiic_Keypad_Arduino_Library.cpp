@@ -0,0 +1,52 @@
+// vim: sts=2 sw=2 fdm=syntax
+#include "SparkFun_Qwiic_Keypad_Arduino_Library.h"
+
+#include "native_fakes.h"
+
+KEYPAD::KEYPAD() {
+  native_fakes::RegisterDevice(this);
+}
+
+bool KEYPAD::begin(TwoWire& wirePort, uint8_t deviceAddress) {
+  (void)wirePort;
+  address_ = deviceAddress;
+  return isConnected();
+}
+
+bool KEYPAD::isConnected() {
+  native_fakes::BusTransaction(address_, 0);
+  return native_fakes::DeviceAt(address_);
+}
+
+// Reading a register is a register address write followed by a read.
+uint8_t KEYPAD::getButton() {
+  native_fakes::BusTransaction(address_, 1);
+  native_fakes::BusTransaction(address_, 1);
+  return button_;
+}
+
+uint16_t KEYPAD::getTimeSinceLastButton() {
+  native_fakes::BusTransaction(address_, 1);
+  native_fakes::BusTransaction(address_, 2);
+  return millis() - button_time_;
+}
+
+void KEYPAD::updateFIFO() {
+  native_fakes::BusTransaction(address_, 2);
+  if (fifo_.empty()) {
+    button_ = 0;
+    return;
+  }
+  button_ = fifo_.front().first;
+  button_time_ = fifo_.front().second;
+  fifo_.pop_front();
+  if (fifo_.empty() && interrupt_pin_ != kNoPin) {
+    native_fakes::SetPin(interrupt_pin_, HIGH);
+  }
+}
+
+void KEYPAD::Press(char c) {
+  // The real keypad's FIFO holds 15 entries and drops the rest.
+  if (fifo_.size() < 15) fifo_.emplace_back(c, millis());
+  if (interrupt_pin_ != kNoPin) native_fakes::SetPin(interrupt_pin_, LOW);
+}
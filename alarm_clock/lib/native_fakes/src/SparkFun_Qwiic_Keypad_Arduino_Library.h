@@ -0,0 +1,39 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+// Fake of the SparkFun Qwiic Keypad library. Keypresses queued from the host
+// with native_fakes::PressKey land in the keypad's FIFO, and come out one at a
+// time through updateFIFO() and getButton(), as on the real keypad.
+
+#include <deque>
+#include "Arduino.h"
+#include "Wire.h"
+
+#define QwiicKeypad_ADDR 0x4B
+
+class KEYPAD {
+  public:
+    KEYPAD();
+
+    bool begin(TwoWire& wirePort = Wire, uint8_t deviceAddress = QwiicKeypad_ADDR);
+    bool isConnected();
+    uint8_t getButton();
+    uint16_t getTimeSinceLastButton();
+    void updateFIFO();
+
+    // Host-side.
+    void Press(char c);
+    // The pin that the keypad's INT line is wired to. The keypad pulls it
+    // LOW when a button is pressed, and lets it go once updateFIFO() has
+    // taken the last button out of the FIFO.
+    void SetInterruptPin(uint8_t pin) { interrupt_pin_ = pin; }
+
+  private:
+    static constexpr uint8_t kNoPin = 0xFF;
+
+    uint8_t address_ = QwiicKeypad_ADDR;
+    uint8_t interrupt_pin_ = kNoPin;
+    std::deque<std::pair<char, unsigned long>> fifo_;
+    uint8_t button_ = 0;
+    unsigned long button_time_ = 0;
+};
@@ -0,0 +1,109 @@
+// vim: sts=2 sw=2 fdm=syntax
+#include "SparkFun_Qwiic_MP3_Trigger_Arduino_Library.h"
+
+#include <stdio.h>
+#include "native_fakes.h"
+
+MP3TRIGGER::MP3TRIGGER() {
+  native_fakes::RegisterDevice(this);
+}
+
+// A command is a single write; a query writes the command and then reads the
+// response.
+void MP3TRIGGER::Command(size_t bytes) {
+  native_fakes::BusTransaction(address_, bytes);
+}
+
+void MP3TRIGGER::Query(size_t response_bytes) {
+  native_fakes::BusTransaction(address_, 1);
+  native_fakes::BusTransaction(address_, response_bytes);
+}
+
+bool MP3TRIGGER::begin(TwoWire& wirePort, uint8_t deviceAddress) {
+  (void)wirePort;
+  address_ = deviceAddress;
+  return isConnected();
+}
+
+bool MP3TRIGGER::isConnected() {
+  Query(1);
+  return native_fakes::DeviceAt(address_);
+}
+
+void MP3TRIGGER::playFile(uint8_t fileNumber) {
+  Command(2);
+  if (fileNumber == 0 || fileNumber > songCount) {
+    // No such file.
+    status_ = 2;
+    stop_millis_ = 0;
+    return;
+  }
+  status_ = 0;
+  file_ = fileNumber;
+  stop_millis_ = millis() + kTrackMillis;
+  play_count_++;
+}
+
+void MP3TRIGGER::playTrack(uint8_t trackNumber) {
+  playFile(trackNumber);
+}
+
+void MP3TRIGGER::stop() {
+  Command(1);
+  stop_millis_ = 0;
+}
+
+void MP3TRIGGER::pause() {
+  stop();
+}
+
+void MP3TRIGGER::setVolume(byte volumeLevel) {
+  Command(2);
+  volume_ = volumeLevel > 31 ? 31 : volumeLevel;
+}
+
+uint8_t MP3TRIGGER::getVolume() {
+  Query(1);
+  return volume_;
+}
+
+void MP3TRIGGER::setEQ(byte eqType) {
+  Command(2);
+  eq_ = eqType > 5 ? 0 : eqType;
+}
+
+uint8_t MP3TRIGGER::getEQ() {
+  Query(1);
+  return eq_;
+}
+
+uint8_t MP3TRIGGER::getStatus() {
+  Query(1);
+  return status_;
+}
+
+bool MP3TRIGGER::hasCard() {
+  Query(1);
+  return true;
+}
+
+uint16_t MP3TRIGGER::getSongCount() {
+  Query(2);
+  return songCount;
+}
+
+String MP3TRIGGER::getSongName() {
+  Query(8);
+  char name[9];
+  snprintf(name, sizeof(name), "F%03d.MP3", file_);
+  return String(name);
+}
+
+bool MP3TRIGGER::isPlayingNow() const {
+  return stop_millis_ != 0 && millis() < stop_millis_;
+}
+
+bool MP3TRIGGER::isPlaying() {
+  Query(1);
+  return isPlayingNow();
+}
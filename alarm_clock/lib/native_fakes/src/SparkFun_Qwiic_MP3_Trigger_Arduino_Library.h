@@ -0,0 +1,49 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+// Fake of the SparkFun Qwiic MP3 Trigger library. Every file on the fake SD
+// card plays for kTrackMillis of virtual time unless stopped.
+
+#include "Arduino.h"
+#include "Wire.h"
+
+class MP3TRIGGER {
+  public:
+    static constexpr unsigned long kTrackMillis = 30000;
+
+    MP3TRIGGER();
+
+    bool begin(TwoWire& wirePort = Wire, uint8_t deviceAddress = 0x37);
+    bool isConnected();
+    void playFile(uint8_t fileNumber);
+    void playTrack(uint8_t trackNumber);
+    void stop();
+    void pause();
+    void setVolume(byte volumeLevel);
+    uint8_t getVolume();
+    void setEQ(byte eqType);
+    uint8_t getEQ();
+    uint8_t getStatus();
+    bool hasCard();
+    uint16_t getSongCount();
+    String getSongName();
+    bool isPlaying();
+
+    // Host-side.
+    uint8_t playingFile() const { return isPlayingNow() ? file_ : 0; }
+    uint32_t playCount() const { return play_count_; }
+    uint16_t songCount = 2;
+
+  private:
+    bool isPlayingNow() const;
+    void Command(size_t bytes);
+    void Query(size_t response_bytes);
+
+    uint8_t address_ = 0x37;
+    uint8_t file_ = 0;
+    unsigned long stop_millis_ = 0;
+    uint8_t volume_ = 10;
+    uint8_t eq_ = 0;
+    uint8_t status_ = 0;
+    uint32_t play_count_ = 0;
+};
@@ -0,0 +1,190 @@
+// vim: sts=2 sw=2 fdm=syntax
+#include "SparkFun_RV1805.h"
+
+#include "native_fakes.h"
+
+namespace native_fakes {
+
+namespace {
+
+// Howard Hinnant's days_from_civil and civil_from_days, rebased to
+// 2000-01-01, which was a Saturday. Both count days in a proleptic calendar
+// whose eras start on 0000-03-01.
+constexpr int64_t kDaysFrom0000To2000 = 730425;
+
+int64_t DaysFromCivil(int64_t y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  const int64_t era = (y >= 0 ? y : y - 399) / 400;
+  const unsigned yoe = static_cast<unsigned>(y - era * 400);
+  const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + static_cast<int64_t>(doe) - kDaysFrom0000To2000;
+}
+
+} // namespace
+
+int64_t SecondsSince2000(uint16_t year, uint8_t month, uint8_t date,
+                         uint8_t hours, uint8_t minutes, uint8_t seconds) {
+  return DaysFromCivil(year, month, date) * 86400 + hours * 3600 +
+         minutes * 60 + seconds;
+}
+
+CivilTime CivilFromSeconds(int64_t s) {
+  int64_t days = s / 86400;
+  int64_t rem = s % 86400;
+  if (rem < 0) {
+    rem += 86400;
+    days--;
+  }
+  CivilTime t;
+  t.hours = rem / 3600;
+  t.minutes = rem / 60 % 60;
+  t.seconds = rem % 60;
+  t.weekday = ((days % 7) + 7 + 6) % 7;
+
+  const int64_t z = days + kDaysFrom0000To2000;
+  const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  const unsigned doe = static_cast<unsigned>(z - era * 146097);
+  const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const unsigned mp = (5 * doy + 2) / 153;
+  t.date = doy - (153 * mp + 2) / 5 + 1;
+  t.month = mp < 10 ? mp + 3 : mp - 9;
+  t.year = static_cast<uint16_t>(yoe + era * 400 + (t.month <= 2));
+  return t;
+}
+
+} // namespace native_fakes
+
+RV1805::RV1805() {
+  native_fakes::RegisterDevice(this);
+}
+
+bool RV1805::begin(TwoWire& wirePort) {
+  (void)wirePort;
+  // Reads the ID register, then configures the oscillator and trickle
+  // charger.
+  native_fakes::BusTransaction(RV1805_ADDR, 1);
+  native_fakes::BusTransaction(RV1805_ADDR, 1);
+  native_fakes::BusTransaction(RV1805_ADDR, 4);
+  return true;
+}
+
+bool RV1805::setTime(uint8_t hund, uint8_t sec, uint8_t min, uint8_t hour,
+                     uint8_t date, uint8_t month, uint16_t year, uint8_t day) {
+  (void)hund;
+  // The RV1805 keeps whatever weekday it is told. The fake derives it from
+  // the date instead, which is what a correctly set clock shows anyway.
+  (void)day;
+  native_fakes::BusTransaction(RV1805_ADDR, 9);
+  Set(native_fakes::SecondsSince2000(year, month, date, hour, min, sec));
+  return true;
+}
+
+bool RV1805::updateTime() {
+  // Like the library, leaves the registers from the last read that worked
+  // when the RTC doesn't answer.
+  if (!native_fakes::BusTransaction(RV1805_ADDR, 1) ||
+      !native_fakes::DeviceAt(RV1805_ADDR) ||
+      !native_fakes::BusTransaction(RV1805_ADDR, 8)) {
+    return false;
+  }
+  const uint64_t elapsed = native_fakes::Micros() - base_micros_;
+  const native_fakes::CivilTime t =
+      native_fakes::CivilFromSeconds(base_seconds_ + elapsed / 1000000);
+  time_[TIME_HUNDREDTHS] = elapsed / 10000 % 100;
+  time_[TIME_SECONDS] = t.seconds;
+  time_[TIME_MINUTES] = t.minutes;
+  time_[TIME_HOURS] = t.hours;
+  time_[TIME_DATE] = t.date;
+  time_[TIME_MONTH] = t.month;
+  time_[TIME_YEAR] = t.year - 2000;
+  time_[TIME_DAY] = t.weekday;
+  return true;
+}
+
+void RV1805::set24Hour() {
+  native_fakes::BusTransaction(RV1805_ADDR, 1);
+  native_fakes::BusTransaction(RV1805_ADDR, 1);
+  native_fakes::BusTransaction(RV1805_ADDR, 2);
+}
+
+int64_t RV1805::Now() const {
+  return base_seconds_ +
+         static_cast<int64_t>((native_fakes::Micros() - base_micros_) / 1000000);
+}
+
+void RV1805::Set(int64_t seconds_since_2000) {
+  base_seconds_ = seconds_since_2000;
+  base_micros_ = native_fakes::Micros();
+  ScheduleAlarm();
+}
+
+bool RV1805::setAlarm(uint8_t sec, uint8_t min, uint8_t hour, uint8_t date,
+                      uint8_t month) {
+  (void)date;
+  (void)month;
+  native_fakes::BusTransaction(RV1805_ADDR, 8);
+  alarm_seconds_ = (hour * 60 + min) * 60 + sec;
+  ScheduleAlarm();
+  return true;
+}
+
+void RV1805::setAlarmMode(uint8_t mode) {
+  native_fakes::BusTransaction(RV1805_ADDR, 1);
+  native_fakes::BusTransaction(RV1805_ADDR, 1);
+  native_fakes::BusTransaction(RV1805_ADDR, 2);
+  alarm_mode_ = mode;
+  ScheduleAlarm();
+}
+
+void RV1805::enableInterrupt(uint8_t source) {
+  native_fakes::BusTransaction(RV1805_ADDR, 1);
+  native_fakes::BusTransaction(RV1805_ADDR, 1);
+  native_fakes::BusTransaction(RV1805_ADDR, 2);
+  interrupts_ |= 1 << source;
+  ScheduleAlarm();
+}
+
+void RV1805::disableInterrupt(uint8_t source) {
+  native_fakes::BusTransaction(RV1805_ADDR, 1);
+  native_fakes::BusTransaction(RV1805_ADDR, 1);
+  native_fakes::BusTransaction(RV1805_ADDR, 2);
+  interrupts_ &= ~(1 << source);
+  ScheduleAlarm();
+}
+
+uint8_t RV1805::status() {
+  native_fakes::BusTransaction(RV1805_ADDR, 1);
+  native_fakes::BusTransaction(RV1805_ADDR, 1);
+  // Nothing answers, so the read gets the bus's pulled up 0xFF.
+  if (!native_fakes::DeviceAt(RV1805_ADDR)) return 0xFF;
+  return status_;
+}
+
+void RV1805::clearInterrupts() {
+  native_fakes::BusTransaction(RV1805_ADDR, 2);
+  status_ = 0;
+  if (interrupt_pin_ >= 0) native_fakes::SetPin(interrupt_pin_, HIGH);
+}
+
+void RV1805::ScheduleAlarm() {
+  const uint32_t generation = ++alarm_generation_;
+  if (alarm_mode_ != 4) return;
+  const int64_t now = Now();
+  int64_t match = now - now % 86400 + alarm_seconds_;
+  if (match <= now) match += 86400;
+  const uint64_t match_micros =
+      base_micros_ + static_cast<uint64_t>(match - base_seconds_) * 1000000;
+  native_fakes::At((match_micros + 999) / 1000,
+                   [this, generation]() { AlarmMatched(generation); });
+}
+
+void RV1805::AlarmMatched(uint32_t generation) {
+  if (generation != alarm_generation_) return;
+  status_ |= 1 << INTERRUPT_AIE;
+  if ((interrupts_ & (1 << INTERRUPT_AIE)) && interrupt_pin_ >= 0) {
+    native_fakes::SetPin(interrupt_pin_, LOW);
+  }
+  ScheduleAlarm();
+}
@@ -0,0 +1,88 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+// Fake of the SparkFun RV1805 library. The fake RTC keeps running on the
+// virtual clock from whatever time it was last set to. As on the real part,
+// the get* accessors return the registers read by the last updateTime(), so
+// while the RTC is unplugged (see native_fakes::Unplug) they keep returning
+// the time it last answered with.
+//
+// Of the alarm modes, only 0 (off) and 4 (daily, when the hours, minutes and
+// seconds match) are modeled. With the alarm interrupt enabled, a match pulls
+// the interrupt pin low until clearInterrupts().
+
+#include "Arduino.h"
+#include "Wire.h"
+
+#define RV1805_ADDR 0x69
+
+// Bits of the interrupt enable register.
+#define INTERRUPT_EIE 0
+#define INTERRUPT_AIE 2
+#define INTERRUPT_TIE 3
+#define INTERRUPT_BLIE 4
+
+enum time_order {
+  TIME_HUNDREDTHS,
+  TIME_SECONDS,
+  TIME_MINUTES,
+  TIME_HOURS,
+  TIME_DATE,
+  TIME_MONTH,
+  TIME_YEAR,
+  TIME_DAY,
+  TIME_ARRAY_LENGTH,
+};
+
+class RV1805 {
+  public:
+    RV1805();
+
+    bool begin(TwoWire& wirePort = Wire);
+    bool setTime(uint8_t hund, uint8_t sec, uint8_t min, uint8_t hour,
+                 uint8_t date, uint8_t month, uint16_t year, uint8_t day);
+    bool updateTime();
+    uint8_t getHundredths() { return time_[TIME_HUNDREDTHS]; }
+    uint8_t getSeconds() { return time_[TIME_SECONDS]; }
+    uint8_t getMinutes() { return time_[TIME_MINUTES]; }
+    uint8_t getHours() { return time_[TIME_HOURS]; }
+    uint8_t getWeekday() { return time_[TIME_DAY]; }
+    uint8_t getDate() { return time_[TIME_DATE]; }
+    uint8_t getMonth() { return time_[TIME_MONTH]; }
+    uint8_t getYear() { return time_[TIME_YEAR]; }
+    void set12Hour() {}
+    void set24Hour();
+    bool is12Hour() { return false; }
+    bool setAlarm(uint8_t sec, uint8_t min, uint8_t hour, uint8_t date,
+                  uint8_t month);
+    void setAlarmMode(uint8_t mode);
+    void enableInterrupt(uint8_t source);
+    void disableInterrupt(uint8_t source);
+    uint8_t status();
+    void clearInterrupts();
+
+    // Host-side. Seconds since 2000-01-01 00:00:00 of the time the RTC
+    // currently shows, and a way to jump it.
+    int64_t Now() const;
+    void Set(int64_t seconds_since_2000);
+    // The pin that the RTC's INT output is wired to.
+    void SetInterruptPin(uint8_t pin) { interrupt_pin_ = pin; }
+
+  private:
+    // Arranges for the next alarm match to happen on the virtual clock.
+    void ScheduleAlarm();
+    void AlarmMatched(uint32_t generation);
+
+    int64_t base_seconds_ = 0;
+    uint64_t base_micros_ = 0;
+    uint8_t time_[TIME_ARRAY_LENGTH] = {};
+    // Seconds since midnight.
+    int32_t alarm_seconds_ = 0;
+    uint8_t alarm_mode_ = 0;
+    uint8_t interrupts_ = 0;
+    uint8_t status_ = 0;
+    int16_t interrupt_pin_ = -1;
+    // Bumped whenever the alarm is rescheduled, so that an earlier schedule
+    // doesn't go off.
+    uint32_t alarm_generation_ = 0;
+};
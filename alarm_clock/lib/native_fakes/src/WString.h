@@ -0,0 +1,29 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+// Just enough of Arduino's String for the SparkFun APIs that return one.
+
+#include <string>
+#include "avr/pgmspace.h"
+
+class __FlashStringHelper;
+#define F(string_literal) \
+  (reinterpret_cast<const __FlashStringHelper*>(PSTR(string_literal)))
+
+class String {
+  public:
+    String() {}
+    String(const char* s): s_(s ? s : "") {}
+    String(const __FlashStringHelper* s)
+      : s_(reinterpret_cast<const char*>(s)) {}
+
+    const char* c_str() const { return s_.c_str(); }
+    unsigned int length() const { return s_.size(); }
+    char operator[](unsigned int i) const { return s_[i]; }
+    bool operator==(const String& other) const { return s_ == other.s_; }
+    String& operator+=(char c) { s_ += c; return *this; }
+    String& operator+=(const char* s) { s_ += s; return *this; }
+
+  private:
+    std::string s_;
+};
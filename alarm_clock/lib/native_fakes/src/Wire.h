@@ -0,0 +1,48 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+// The SparkFun device fakes model their traffic directly with
+// native_fakes::BusTransaction, so TwoWire only needs to remember the clock
+// speed and timeout, and answer the raw transactions that the firmware makes
+// itself.
+
+#include "Arduino.h"
+
+class TwoWire {
+  public:
+    void begin() {}
+    void end() {}
+    void setClock(uint32_t clock) { clock_ = clock; }
+    uint32_t getClock() const { return clock_; }
+
+    // As in the AVR core's Wire: 0 (the default) waits forever.
+    void setWireTimeout(uint32_t timeout = 25000,
+                        bool reset_with_timeout = false) {
+      (void)reset_with_timeout;
+      timeout_ = timeout;
+    }
+    bool getWireTimeoutFlag() const { return timed_out_; }
+    void clearWireTimeoutFlag() { timed_out_ = false; }
+    // For native_fakes::BusTransaction.
+    uint32_t wireTimeout() const { return timeout_; }
+    void setWireTimeoutFlag() { timed_out_ = true; }
+
+    void beginTransmission(uint8_t address);
+    size_t write(uint8_t) { bytes_++; return 1; }
+    size_t write(const uint8_t*, size_t n) { bytes_ += n; return n; }
+    // Returns 0 (success) if a fake device answers at the address, 2
+    // (address NACK) if not, and 5 if the transaction timed out.
+    uint8_t endTransmission(bool sendStop = true);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, bool sendStop = true);
+    int available() { return 0; }
+    int read() { return -1; }
+
+  private:
+    uint32_t clock_ = 100000;
+    uint32_t timeout_ = 0;
+    bool timed_out_ = false;
+    uint8_t address_ = 0;
+    size_t bytes_ = 0;
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,27 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+// Interrupt handlers. ISR(vector) defines a handler that the fakes call when
+// the corresponding event happens, e.g. a pin change on a pin enabled in
+// PCMSK2, or a millisecond passing with OCIE0A set in TIMSK0 (see avr/io.h).
+
+#include <stdint.h>
+
+namespace native_fakes {
+bool RegisterIsr(uint8_t vector, void (*isr)());
+} // namespace native_fakes
+
+// The ATmega328's vector numbers.
+#define PCINT0_vect 3
+#define PCINT1_vect 4
+#define PCINT2_vect 5
+#define TIMER0_COMPA_vect 14
+
+#define ISR(vector, ...)                                                     \
+  static void vector##_isr();                                                \
+  __attribute__((unused)) static const bool vector##_registered =            \
+      native_fakes::RegisterIsr(vector, vector##_isr);                       \
+  static void vector##_isr()
+
+#define sei()
+#define cli()
@@ -0,0 +1,50 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+// The few ATmega328 registers that the firmware touches directly. Writing
+// them has the same effect on the fake pins as on the real chip.
+
+#include <stdint.h>
+
+// Pin change interrupts.
+extern volatile uint8_t PCICR;
+extern volatile uint8_t PCMSK0;
+extern volatile uint8_t PCMSK1;
+extern volatile uint8_t PCMSK2;
+
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+
+// Bit numbers within PCMSK0 (pins 8-13), PCMSK1 (A0-A5) and PCMSK2 (pins
+// 0-7).
+#define PCINT0 0
+#define PCINT1 1
+#define PCINT2 2
+#define PCINT3 3
+#define PCINT4 4
+#define PCINT5 5
+#define PCINT8 0
+#define PCINT9 1
+#define PCINT10 2
+#define PCINT11 3
+#define PCINT12 4
+#define PCINT13 5
+#define PCINT16 0
+#define PCINT17 1
+#define PCINT18 2
+#define PCINT19 3
+#define PCINT20 4
+#define PCINT21 5
+#define PCINT22 6
+#define PCINT23 7
+
+// Timer0 runs millis(). Enabling its compare match A interrupt gets
+// TIMER0_COMPA_vect called once a millisecond as well, at the point in the
+// count that OCR0A selects (the fakes ignore OCR0A).
+extern volatile uint8_t TIMSK0;
+extern volatile uint8_t OCR0A;
+
+#define TOIE0 0
+#define OCIE0A 1
+#define OCIE0B 2
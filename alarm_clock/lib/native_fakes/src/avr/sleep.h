@@ -0,0 +1,17 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+// Sleep modes. In the fakes, every mode sleeps until the next interrupt,
+// which is at most until the next Timer0 tick, on the next whole millisecond.
+
+#include <stdint.h>
+
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_ADC 1
+#define SLEEP_MODE_PWR_DOWN 2
+#define SLEEP_MODE_PWR_SAVE 3
+
+#define set_sleep_mode(mode)
+#define sleep_enable()
+#define sleep_disable()
+void sleep_mode();
@@ -0,0 +1,455 @@
+// vim: sts=2 sw=2 fdm=syntax
+#include "native_fakes.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <chrono>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include "Arduino.h"
+#include "avr/sleep.h"
+#include "EEPROM.h"
+#include "i2c_stats.h"
+#include "SerLCD.h"
+#include "SparkFun_Qwiic_Keypad_Arduino_Library.h"
+#include "SparkFun_Qwiic_MP3_Trigger_Arduino_Library.h"
+#include "SparkFun_RV1805.h"
+#include "Wire.h"
+
+HardwareSerial Serial;
+volatile uint8_t PCICR;
+volatile uint8_t PCMSK0;
+volatile uint8_t PCMSK1;
+volatile uint8_t PCMSK2;
+volatile uint8_t TIMSK0;
+volatile uint8_t OCR0A;
+TwoWire Wire;
+EEPROMClass EEPROM;
+
+namespace native_fakes {
+
+namespace {
+
+uint64_t now_micros = 0;
+bool real_time = false;
+// The host's time when virtual time was 0.
+std::chrono::steady_clock::time_point host_epoch;
+std::multimap<uint64_t, std::function<void()>> events;
+// When TIMER0_COMPA_vect is next due, if it's enabled.
+uint64_t next_timer0_micros = 0;
+
+constexpr uint8_t kNumPins = 20;
+bool pin_level[kNumPins];
+bool pin_pulled_up[kNumPins];
+
+// SCL pulses until the device holding SDA low lets go, or 0.
+uint8_t stuck_pulses = 0;
+std::set<uint8_t> unplugged;
+
+struct Interrupt {
+  void (*isr)() = nullptr;
+  int mode = 0;
+};
+Interrupt interrupts[2];
+
+// Handlers defined with ISR(), by vector number.
+constexpr uint8_t kNumVectors = 26;
+void (*isrs[kNumVectors])();
+
+void PinChanged(uint8_t pin) {
+  const uint8_t group = digitalPinToPCICRbit(pin);
+  if (!(PCICR & bit(group))) return;
+  if (!(*digitalPinToPCMSK(pin) & bit(digitalPinToPCMSKbit(pin)))) return;
+  void (*isr)() = isrs[PCINT0_vect + group];
+  if (isr != nullptr) isr();
+}
+
+SerLCD* lcd = nullptr;
+KEYPAD* keypad = nullptr;
+MP3TRIGGER* mp3 = nullptr;
+RV1805* rtc = nullptr;
+
+std::function<void(const char*)> serial_listener;
+std::string serial_line;
+
+// Blank, like a new ATmega's EEPROM, which reads as all 0xFF.
+struct Eeprom {
+  Eeprom() { memset(bytes, 0xFF, sizeof(bytes)); }
+  uint8_t bytes[EEPROMClass::kLength];
+} eeprom;
+const char* eeprom_file = nullptr;
+uint32_t eeprom_writes = 0;
+
+} // namespace
+
+uint64_t Micros() {
+  return now_micros;
+}
+
+namespace {
+
+void Advance(uint64_t us, bool run_timer0) {
+  const uint64_t target = now_micros + us;
+  while (true) {
+    const bool timer0 = run_timer0 && (TIMSK0 & bit(OCIE0A)) &&
+                        isrs[TIMER0_COMPA_vect];
+    if (timer0 && next_timer0_micros < now_micros) {
+      // Just enabled, or enabled a long time ago: the next tick is at the
+      // next whole millisecond.
+      next_timer0_micros = now_micros / 1000 * 1000 + 1000;
+    }
+    const bool event_due = !events.empty() && events.begin()->first <= target;
+    const bool tick_due = timer0 && next_timer0_micros <= target;
+    if (tick_due &&
+        (!event_due || next_timer0_micros <= events.begin()->first)) {
+      now_micros = next_timer0_micros;
+      next_timer0_micros += 1000;
+      isrs[TIMER0_COMPA_vect]();
+    } else if (event_due) {
+      auto next = events.begin();
+      if (next->first > now_micros) now_micros = next->first;
+      std::function<void()> event = std::move(next->second);
+      events.erase(next);
+      event();
+    } else {
+      break;
+    }
+  }
+  if (target > now_micros) now_micros = target;
+}
+
+} // namespace
+
+void AdvanceMicros(uint64_t us) {
+  Advance(us, true);
+}
+
+void SkipMicros(uint64_t us) {
+  Advance(us, false);
+}
+
+void SetRealTime() {
+  real_time = true;
+  host_epoch = std::chrono::steady_clock::now() -
+               std::chrono::microseconds(now_micros);
+}
+
+void WaitForHost() {
+  if (!real_time) return;
+  std::this_thread::sleep_until(host_epoch +
+                                std::chrono::microseconds(now_micros));
+}
+
+void At(unsigned long millis, std::function<void()> event) {
+  events.emplace(millis * 1000ULL, std::move(event));
+}
+
+uint64_t NextEventMicros() {
+  return events.empty() ? UINT64_MAX : events.begin()->first;
+}
+
+bool BusTransaction(uint8_t address, size_t bytes) {
+  if (stuck_pulses > 0) {
+    if (Wire.wireTimeout() == 0) {
+      fflush(stdout);
+      fprintf(stderr, "t=%lu ms: I2C bus hung, with SDA held low\n", millis());
+      exit(1);
+    }
+    AdvanceMicros(Wire.wireTimeout());
+    Wire.setWireTimeoutFlag();
+    i2c_stats::Record(address, 0, Wire.wireTimeout());
+    return false;
+  }
+  // Start, address byte, payload, stop: 9 clocks per byte including the ACK.
+  const uint64_t bits = 9 * (bytes + 1) + 2;
+  const uint64_t us = bits * 1000000 / Wire.getClock();
+  AdvanceMicros(us);
+  i2c_stats::Record(address, bytes, us);
+  return true;
+}
+
+void StickBus(uint8_t pulses) {
+  stuck_pulses = pulses;
+}
+
+void Unplug(uint8_t address) {
+  unplugged.insert(address);
+}
+
+void Plug(uint8_t address) {
+  unplugged.erase(address);
+}
+
+void SetPin(uint8_t pin, bool level) {
+  if (pin >= kNumPins) return;
+  const bool old_level = pin_level[pin];
+  pin_level[pin] = level;
+  if (old_level == level) return;
+  if (pin == SCL && !level && stuck_pulses > 0) stuck_pulses--;
+  PinChanged(pin);
+  const int interrupt = digitalPinToInterrupt(pin);
+  if (interrupt == NOT_AN_INTERRUPT) return;
+  const Interrupt& i = interrupts[interrupt];
+  if (i.isr == nullptr) return;
+  if (i.mode == CHANGE ||
+      (i.mode == FALLING && !level) ||
+      (i.mode == RISING && level)) {
+    i.isr();
+  }
+}
+
+bool RegisterIsr(uint8_t vector, void (*isr)()) {
+  if (vector >= kNumVectors) return false;
+  isrs[vector] = isr;
+  return true;
+}
+
+bool GetPin(uint8_t pin) {
+  if (pin == SDA && stuck_pulses > 0) return false;
+  return pin < kNumPins && pin_level[pin];
+}
+
+SerLCD* Lcd() { return lcd; }
+KEYPAD* Keypad() { return keypad; }
+MP3TRIGGER* Mp3() { return mp3; }
+RV1805* Rtc() { return rtc; }
+
+void RegisterDevice(SerLCD* d) { lcd = d; }
+void RegisterDevice(KEYPAD* d) { keypad = d; }
+void RegisterDevice(MP3TRIGGER* d) { mp3 = d; }
+void RegisterDevice(RV1805* d) { rtc = d; }
+
+void CaptureSerial(std::function<void(const char* line)> listener) {
+  serial_listener = std::move(listener);
+}
+
+void SerialOutput(uint8_t c) {
+  if (!serial_listener) {
+    putchar(c);
+  } else if (c == '\n') {
+    serial_listener(serial_line.c_str());
+    serial_line.clear();
+  } else if (c != '\r') {
+    serial_line += static_cast<char>(c);
+  }
+}
+
+void PressKey(char c) {
+  if (keypad != nullptr) keypad->Press(c);
+}
+
+void RenderLcd(char (&out)[2][17]) {
+  for (uint8_t row = 0; row < 2; row++) {
+    for (uint8_t col = 0; col < 16; col++) {
+      uint8_t c = lcd == nullptr ? ' ' : lcd->cell(col, row);
+      if (c < 8) {
+        c = '#';
+      } else if (c == 0b10100101) {
+        c = ':';
+      } else if (c < ' ' || c > '~') {
+        c = '?';
+      }
+      out[row][col] = c;
+    }
+    out[row][16] = '\0';
+  }
+}
+
+void SetRtc(uint16_t year, uint8_t month, uint8_t date,
+            uint8_t hours, uint8_t minutes, uint8_t seconds) {
+  if (rtc == nullptr) return;
+  rtc->Set(SecondsSince2000(year, month, date, hours, minutes, seconds));
+}
+
+void SetEepromFile(const char* path) {
+  eeprom_file = path;
+  FILE* f = fopen(path, "rb");
+  if (f == nullptr) return;
+  size_t n = fread(eeprom.bytes, 1, sizeof(eeprom.bytes), f);
+  (void)n;
+  fclose(f);
+}
+
+uint32_t EepromWrites() {
+  return eeprom_writes;
+}
+
+uint8_t EepromRead(int idx) {
+  return eeprom.bytes[idx % EEPROMClass::kLength];
+}
+
+void EepromWrite(int idx, uint8_t val) {
+  eeprom.bytes[idx % EEPROMClass::kLength] = val;
+  eeprom_writes++;
+  AdvanceMicros(3300);
+  if (eeprom_file == nullptr) return;
+  FILE* f = fopen(eeprom_file, "wb");
+  if (f == nullptr) return;
+  fwrite(eeprom.bytes, 1, sizeof(eeprom.bytes), f);
+  fclose(f);
+}
+
+bool DeviceAt(uint8_t address) {
+  if (unplugged.count(address)) return false;
+  return address == 0x37 || address == 0x4B || address == 0x69 ||
+         address == 0x72;
+}
+
+} // namespace native_fakes
+
+unsigned long millis() {
+  return native_fakes::Micros() / 1000;
+}
+
+unsigned long micros() {
+  return native_fakes::Micros();
+}
+
+void delay(unsigned long ms) {
+  native_fakes::AdvanceMicros(ms * 1000ULL);
+}
+
+void delayMicroseconds(unsigned int us) {
+  native_fakes::AdvanceMicros(us);
+}
+
+void sleep_mode() {
+  native_fakes::AdvanceMicros(1000 - native_fakes::Micros() % 1000);
+  native_fakes::WaitForHost();
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  using namespace native_fakes;
+  if (pin >= kNumPins) return;
+  pin_pulled_up[pin] = mode == INPUT_PULLUP;
+  if (pin_pulled_up[pin]) pin_level[pin] = true;
+}
+
+int digitalRead(uint8_t pin) {
+  return native_fakes::GetPin(pin) ? HIGH : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  native_fakes::SetPin(pin, val != LOW);
+}
+
+void attachInterrupt(uint8_t interrupt, void (*isr)(), int mode) {
+  if (interrupt >= 2) return;
+  native_fakes::interrupts[interrupt].isr = isr;
+  native_fakes::interrupts[interrupt].mode = mode;
+}
+
+void detachInterrupt(uint8_t interrupt) {
+  if (interrupt >= 2) return;
+  native_fakes::interrupts[interrupt].isr = nullptr;
+}
+
+namespace {
+
+struct FdevCookie {
+  int (*put)(char, FILE*);
+  FILE* file;
+  void* udata;
+};
+
+std::map<FILE*, FdevCookie*> fdev_cookies;
+
+ssize_t FdevWrite(void* cookie, const char* buf, size_t size) {
+  FdevCookie* c = static_cast<FdevCookie*>(cookie);
+  for (size_t i = 0; i < size; i++) {
+    c->put(buf[i], c->file);
+  }
+  return size;
+}
+
+} // namespace
+
+FILE* fdevopen(int (*put)(char, FILE*), int (*get)(FILE*)) {
+  (void)get;
+  FdevCookie* cookie = new FdevCookie{put, nullptr, nullptr};
+  cookie_io_functions_t io = {nullptr, FdevWrite, nullptr, nullptr};
+  FILE* f = fopencookie(cookie, "w", io);
+  // avr-libc streams are unbuffered: every character goes straight to put().
+  setvbuf(f, nullptr, _IONBF, 0);
+  cookie->file = f;
+  fdev_cookies[f] = cookie;
+  return f;
+}
+
+void fdev_set_udata(FILE* f, void* u) {
+  fdev_cookies[f]->udata = u;
+}
+
+void* fdev_get_udata(FILE* f) {
+  return fdev_cookies[f]->udata;
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+  (void)baud;
+  fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+}
+
+int HardwareSerial::available() {
+  if (peeked_ >= 0) return 1;
+  peeked_ = read();
+  return peeked_ >= 0 ? 1 : 0;
+}
+
+int HardwareSerial::read() {
+  if (peeked_ >= 0) {
+    int c = peeked_;
+    peeked_ = -1;
+    return c;
+  }
+  unsigned char c;
+  if (::read(STDIN_FILENO, &c, 1) == 1) return c;
+  return -1;
+}
+
+int HardwareSerial::peek() {
+  available();
+  return peeked_;
+}
+
+void HardwareSerial::flush() {
+  fflush(stdout);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  native_fakes::SerialOutput(c);
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  for (size_t i = 0; i < size; i++) native_fakes::SerialOutput(buffer[i]);
+  return size;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  address_ = address;
+  bytes_ = 0;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+  (void)sendStop;
+  if (!native_fakes::BusTransaction(address_, bytes_)) return 5;
+  return native_fakes::DeviceAt(address_) ? 0 : 2;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, bool sendStop) {
+  (void)sendStop;
+  native_fakes::BusTransaction(address, quantity);
+  return 0;
+}
+
+uint8_t EEPROMClass::read(int idx) {
+  return native_fakes::EepromRead(idx);
+}
+
+void EEPROMClass::write(int idx, uint8_t val) {
+  native_fakes::EepromWrite(idx, val);
+}
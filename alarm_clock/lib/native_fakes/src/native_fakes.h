@@ -0,0 +1,127 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+// The host-side controls for the native build.
+//
+// The firmware only ever sees the Arduino and SparkFun APIs, exactly as it
+// does on the RedBoard. Everything in this header is for the host program
+// (native_main.cpp, or a test) to drive the fakes: advance the virtual clock,
+// press buttons, type on the keypad, and look at what ended up on the LCD.
+//
+// Time is virtual. millis() and micros() only advance when the firmware
+// calls delay(), or when a fake device models the time a bus transaction
+// (or a SerLCD command delay) would have taken on the real hardware. That
+// makes runs deterministic, and makes the virtual time spent per loop() a
+// direct measure of how long the loop would take on the bench.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+
+class SerLCD;
+class KEYPAD;
+class MP3TRIGGER;
+class RV1805;
+
+namespace native_fakes {
+
+// Virtual time, in microseconds since the program started.
+uint64_t Micros();
+void AdvanceMicros(uint64_t us);
+// Moves the virtual clock forward like AdvanceMicros(), except that Timer0's
+// interrupt doesn't run: a stretch of time in which the firmware did
+// nothing, skipped over quickly. Events (see At()) still fire on time.
+void SkipMicros(uint64_t us);
+// From now on, whenever the firmware sleeps, waits for the host's clock to
+// catch up with the virtual clock, so that the firmware keeps real time,
+// e.g. for a program talking to it over stdin and stdout.
+void SetRealTime();
+// Used by sleep_mode().
+void WaitForHost();
+
+// Runs `event` once the virtual clock reaches `millis`. Events fire from
+// inside whatever delay() or bus transaction carries the clock past them, so
+// they reach the firmware even while it is blocked (in delay() or a long
+// EEPROM write), just like an interrupt or a keypress would.
+void At(unsigned long millis, std::function<void()> event);
+// When the next event is due, in microseconds, or UINT64_MAX if there is
+// none.
+uint64_t NextEventMicros();
+
+// Models a single I2C transaction of `bytes` payload bytes to `address`:
+// advances the virtual clock by the time the transfer would take at the
+// current Wire clock speed, and counts it in the firmware's i2c_stats.
+// Returns false if the transaction timed out (see StickBus()).
+bool BusTransaction(uint8_t address, size_t bytes);
+
+// I2C faults, like the ones a power sag causes. After StickBus(), a device
+// holds SDA low until SCL has been pulsed `pulses` times; until then, every
+// transaction times out after Wire's timeout, or hangs the program if Wire
+// has none. An unplugged device doesn't answer its address.
+void StickBus(uint8_t pulses);
+void Unplug(uint8_t address);
+void Plug(uint8_t address);
+
+// Digital pins. Pins configured INPUT_PULLUP read HIGH until the host pulls
+// them LOW. Changing a pin's level runs any interrupt attached to it. SDA
+// reads LOW while the bus is stuck.
+void SetPin(uint8_t pin, bool level);
+bool GetPin(uint8_t pin);
+// Called by the ISR() macro.
+bool RegisterIsr(uint8_t vector, void (*isr)());
+
+// Hands the firmware's Serial output to `listener` one line at a time,
+// without the line ending, instead of writing it to stdout.
+void CaptureSerial(std::function<void(const char* line)> listener);
+
+// The most recently constructed instance of each device. The firmware
+// declares exactly one of each.
+SerLCD* Lcd();
+KEYPAD* Keypad();
+MP3TRIGGER* Mp3();
+RV1805* Rtc();
+
+// Queues a keypress in the keypad's FIFO.
+void PressKey(char c);
+
+// Renders the LCD's current contents as two lines of text. Custom characters
+// 0-7 (the double high digits) are shown as '#', and the HD44780 middle dot
+// used for the colon is shown as ':'.
+void RenderLcd(char (&out)[2][17]);
+
+// Sets the fake RTC to the given local time. The weekday register is
+// computed from the date (0-6, Sunday first, like the firmware expects).
+void SetRtc(uint16_t year, uint8_t month, uint8_t date,
+            uint8_t hours, uint8_t minutes, uint8_t seconds);
+
+// The EEPROM starts out blank, as all 0xFF, like a new ATmega's. If a backing
+// file is set, it is loaded now and rewritten whenever the firmware writes to
+// the EEPROM.
+void SetEepromFile(const char* path);
+uint32_t EepromWrites();
+
+// Used by the fakes themselves.
+void RegisterDevice(SerLCD* lcd);
+void RegisterDevice(KEYPAD* keypad);
+void RegisterDevice(MP3TRIGGER* mp3);
+void RegisterDevice(RV1805* rtc);
+bool DeviceAt(uint8_t address);
+uint8_t EepromRead(int idx);
+void EepromWrite(int idx, uint8_t val);
+void SerialOutput(uint8_t c);
+
+// Calendar conversions for the fake RTC, valid from 2000 through 2099.
+int64_t SecondsSince2000(uint16_t year, uint8_t month, uint8_t date,
+                         uint8_t hours, uint8_t minutes, uint8_t seconds);
+struct CivilTime {
+  uint16_t year;
+  uint8_t month;
+  uint8_t date;
+  uint8_t hours;
+  uint8_t minutes;
+  uint8_t seconds;
+  uint8_t weekday;
+};
+CivilTime CivilFromSeconds(int64_t seconds_since_2000);
+
+} // namespace native_fakes
@@ -0,0 +1,182 @@
+// vim: sts=2 sw=2 fdm=syntax
+// The native build's entry point: runs the firmware's setup() and loop() on
+// the virtual clock, optionally typing a script of keypresses, and reports
+// what the loop cost.
+//
+//   alarm_clock [-s seconds] [-c "YYYY-MM-DD HH:MM:SS"] [-k keys]
+//               [-e eeprom.bin] [-x scenario] [-r] [-v]
+//
+//   -s  virtual seconds to run for (default 60)
+//   -c  what the RTC reads at startup (default: the host's local time)
+//   -k  keys to type, one every 300 ms once setup() is done. Keypad keys are
+//       0-9, * and #; 's' and 'z' tap the stop and snooze buttons, 'S' holds
+//       the stop button down for 3 seconds, and '.' waits a second.
+//   -e  file that holds the EEPROM contents between runs
+//   -x  run a scenario (see simulation.h) instead of for -s seconds from -c
+//   -r  keep the virtual clock in step with the host's, rather than running
+//       as fast as possible, for talking to the serial console from another
+//       program (like tools/provision.py)
+//   -v  print the LCD every time its contents change (not with -x)
+//
+// Serial output from the firmware goes to stdout, and stdin is the Serial
+// input. At the end of the run, the I2C traffic report and the loop profile
+// (the same ones the firmware prints for the "i2c" and "prof" console
+// commands) go to stdout as well.
+// Scenarios print only their failed checks and a summary, and exit with 1 if
+// any check failed.
+
+#ifndef PIO_UNIT_TESTING
+
+#include <time.h>
+#include <unistd.h>
+#include <chrono>
+#include "Arduino.h"
+#include "i2c_stats.h"
+#include "native_fakes.h"
+#include "profiler.h"
+#include "SparkFun_Qwiic_Keypad_Arduino_Library.h"
+#include "SparkFun_RV1805.h"
+#include "simulation.h"
+
+namespace {
+
+constexpr unsigned long kLcdSampleMillis = 50;
+constexpr uint8_t kKeypadInterruptPin = 4;
+constexpr uint8_t kRtcInterruptPin = 5;
+
+unsigned long setup_millis = 0;
+unsigned long loops = 0;
+std::chrono::steady_clock::time_point host_start;
+char last_screen[2][17];
+
+void Usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [-s seconds] [-c \"YYYY-MM-DD HH:MM:SS\"] [-k keys] "
+          "[-e eeprom.bin] [-x scenario] [-r] [-v]\n", argv0);
+  exit(2);
+}
+
+void PrintLcd(FILE* out) {
+  char screen[2][17];
+  native_fakes::RenderLcd(screen);
+  fprintf(out, "+----------------+\n|%s|\n|%s|\n+----------------+\n",
+          screen[0], screen[1]);
+}
+
+void SampleLcd() {
+  char screen[2][17];
+  native_fakes::RenderLcd(screen);
+  if (memcmp(screen, last_screen, sizeof(screen)) != 0) {
+    memcpy(last_screen, screen, sizeof(screen));
+    fflush(stdout);
+    fprintf(stderr, "t=%lu ms\n", millis());
+    PrintLcd(stderr);
+  }
+  native_fakes::At(millis() + kLcdSampleMillis, SampleLcd);
+}
+
+// Runs when the virtual clock reaches the end of the run, wherever the
+// firmware happens to be at the time.
+void Finish() {
+  const auto host_elapsed = std::chrono::steady_clock::now() - host_start;
+  const double host_micros =
+      std::chrono::duration<double, std::micro>(host_elapsed).count();
+  const unsigned long loop_millis = millis() - setup_millis;
+  fflush(stdout);
+  PrintLcd(stderr);
+  fprintf(stderr, "setup(): %lu ms\n", setup_millis);
+  fprintf(stderr, "loop(): %lu iterations in %lu ms, %.1f ms each (virtual), "
+          "%.2f us each (host)\n",
+          loops, loop_millis,
+          loops ? static_cast<double>(loop_millis) / loops : 0.0,
+          loops ? host_micros / loops : 0.0);
+  fprintf(stderr, "EEPROM bytes written: %u\n", native_fakes::EepromWrites());
+  i2c_stats::Report(Serial);
+#ifdef ALARM_CLOCK_PROFILE
+  profiler::Report(Serial);
+#endif
+  exit(0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  unsigned long run_seconds = 60;
+  const char* clock = nullptr;
+  const char* keys = "";
+  const char* scenario = nullptr;
+  bool real_time = false;
+  bool verbose = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:c:k:e:x:rv")) != -1) {
+    switch (opt) {
+      case 's':
+        run_seconds = strtoul(optarg, nullptr, 10);
+        break;
+      case 'c':
+        clock = optarg;
+        break;
+      case 'k':
+        keys = optarg;
+        break;
+      case 'e':
+        native_fakes::SetEepromFile(optarg);
+        break;
+      case 'x':
+        scenario = optarg;
+        break;
+      case 'r':
+        real_time = true;
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      default:
+        Usage(argv[0]);
+    }
+  }
+
+  unsigned year, month, date, hours, minutes, seconds;
+  if (scenario != nullptr) {
+    if (!simulation::Load(scenario)) exit(2);
+  } else if (clock != nullptr) {
+    if (sscanf(clock, "%u-%u-%u %u:%u:%u",
+               &year, &month, &date, &hours, &minutes, &seconds) != 6) {
+      Usage(argv[0]);
+    }
+  } else {
+    time_t now = time(nullptr);
+    struct tm local;
+    localtime_r(&now, &local);
+    year = local.tm_year + 1900;
+    month = local.tm_mon + 1;
+    date = local.tm_mday;
+    hours = local.tm_hour;
+    minutes = local.tm_min;
+    seconds = local.tm_sec;
+  }
+  if (scenario != nullptr) {
+    native_fakes::Rtc()->Set(simulation::StartSeconds());
+  } else {
+    native_fakes::SetRtc(year, month, date, hours, minutes, seconds);
+  }
+
+  host_start = std::chrono::steady_clock::now();
+  native_fakes::Keypad()->SetInterruptPin(kKeypadInterruptPin);
+  native_fakes::Rtc()->SetInterruptPin(kRtcInterruptPin);
+  setup();
+  setup_millis = millis();
+  if (real_time) native_fakes::SetRealTime();
+
+  simulation::ScheduleKeys(keys, setup_millis);
+  if (scenario != nullptr) return simulation::Run();
+  if (verbose) SampleLcd();
+  native_fakes::At(setup_millis + run_seconds * 1000, Finish);
+
+  while (true) {
+    loop();
+    loops++;
+  }
+}
+
+#endif // PIO_UNIT_TESTING
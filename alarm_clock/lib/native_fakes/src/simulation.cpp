@@ -0,0 +1,344 @@
+// vim: sts=2 sw=2 fdm=syntax
+#include "simulation.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "native_fakes.h"
+#include "SparkFun_Qwiic_MP3_Trigger_Arduino_Library.h"
+#include "SparkFun_RV1805.h"
+
+namespace simulation {
+
+namespace {
+
+constexpr unsigned long kKeyIntervalMillis = 300;
+constexpr unsigned long kButtonTapMillis = 100;
+constexpr unsigned long kButtonHoldMillis = 3000;
+constexpr uint8_t kStopButtonPin = 2;
+constexpr uint8_t kSnoozeButtonPin = 3;
+constexpr uint8_t kRtcInterruptPin = 5;
+
+// How long the firmware runs before each time that the scenario visits, so
+// that it has read the clock and acted on it by then.
+constexpr int64_t kLeadSeconds = 2;
+constexpr int64_t kSecondsPerDay = 24 * 60 * 60;
+constexpr int64_t kNever = INT64_MAX;
+
+const char* const kDayNames[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri",
+                                 "Sat"};
+
+enum Repeat {
+  kOnce,
+  kDaily,
+  kWeekly,
+};
+
+enum Command {
+  kKeys,
+  kExpect,
+  kExpectPlay,
+  kStickBus,
+  kUnplug,
+  kPlug,
+};
+
+struct Line {
+  int number;
+  Repeat repeat;
+  // For kOnce, seconds since 2000. Otherwise, seconds since midnight on
+  // `weekday` (kWeekly) or any day (kDaily).
+  int64_t at;
+  uint8_t weekday;
+  Command command;
+  std::string arg;
+  // When the line runs next, in seconds since 2000.
+  int64_t next;
+};
+
+std::vector<Line> lines;
+int64_t start_seconds = -1;
+int64_t end_seconds = -1;
+
+// What the firmware has said on Serial.
+std::string state = "WAITING";
+unsigned transitions = 0;
+
+// When the last key typed by the scenario has been released.
+unsigned long typing_done = 0;
+
+unsigned checks = 0;
+unsigned failures = 0;
+
+void PressButton(uint8_t pin, unsigned long length_millis) {
+  native_fakes::SetPin(pin, LOW);
+  native_fakes::At(millis() + length_millis,
+                   [pin]() { native_fakes::SetPin(pin, HIGH); });
+}
+
+bool ParseDateTime(const char* s, int64_t* seconds, int* length) {
+  unsigned year, month, date, hours, minutes, secs;
+  if (sscanf(s, "%u-%u-%u %u:%u:%u%n", &year, &month, &date, &hours,
+             &minutes, &secs, length) != 6) {
+    return false;
+  }
+  if (year < 2000 || year > 2099 || month < 1 || month > 12 || date < 1 ||
+      date > 31 || hours > 23 || minutes > 59 || secs > 59) {
+    return false;
+  }
+  *seconds = native_fakes::SecondsSince2000(year, month, date, hours, minutes,
+                                            secs);
+  return true;
+}
+
+bool ParseTime(const char* s, int64_t* seconds, int* length) {
+  unsigned hours, minutes, secs;
+  if (sscanf(s, "%u:%u:%u%n", &hours, &minutes, &secs, length) != 3) {
+    return false;
+  }
+  if (hours > 23 || minutes > 59 || secs > 59) return false;
+  *seconds = (hours * 60 + minutes) * 60 + secs;
+  return true;
+}
+
+bool ParseLine(const char* p, int number) {
+  int length = 0;
+  if (strncmp(p, "start ", 6) == 0) {
+    return ParseDateTime(p + 6, &start_seconds, &length) &&
+           p[6 + length] == '\0';
+  }
+  if (strncmp(p, "end ", 4) == 0) {
+    return ParseDateTime(p + 4, &end_seconds, &length) &&
+           p[4 + length] == '\0';
+  }
+
+  Line line = {};
+  line.number = number;
+  if (strncmp(p, "daily ", 6) == 0) {
+    line.repeat = kDaily;
+    p += 6;
+  } else {
+    line.repeat = kOnce;
+    for (uint8_t day = 0; day < 7; day++) {
+      if (strncmp(p, kDayNames[day], 3) == 0 && p[3] == ' ') {
+        line.repeat = kWeekly;
+        line.weekday = day;
+        p += 4;
+      }
+    }
+  }
+  const bool parsed = line.repeat == kOnce
+      ? ParseDateTime(p, &line.at, &length)
+      : ParseTime(p, &line.at, &length);
+  if (!parsed || p[length] != ' ') return false;
+  p += length + strspn(p + length, " ");
+
+  const size_t command_length = strcspn(p, " ");
+  const std::string command(p, command_length);
+  if (command == "keys") {
+    line.command = kKeys;
+  } else if (command == "expect") {
+    line.command = kExpect;
+  } else if (command == "expect-play") {
+    line.command = kExpectPlay;
+  } else if (command == "stick-bus") {
+    line.command = kStickBus;
+  } else if (command == "unplug") {
+    line.command = kUnplug;
+  } else if (command == "plug") {
+    line.command = kPlug;
+  } else {
+    return false;
+  }
+  p += command_length + strspn(p + command_length, " ");
+  if (*p == '\0') return false;
+  line.arg = p;
+  lines.push_back(line);
+  return true;
+}
+
+// The first time at or after `t` that `line` runs.
+int64_t NextRun(const Line& line, int64_t t) {
+  if (line.repeat == kOnce) return line.at >= t ? line.at : kNever;
+  const int64_t midnight = t - t % kSecondsPerDay;
+  int64_t next = midnight + line.at;
+  if (line.repeat == kDaily) {
+    return next >= t ? next : next + kSecondsPerDay;
+  }
+  const uint8_t weekday = native_fakes::CivilFromSeconds(midnight).weekday;
+  next += (line.weekday - weekday + 7) % 7 * kSecondsPerDay;
+  return next >= t ? next : next + 7 * kSecondsPerDay;
+}
+
+void Check(const Line& line, int64_t t, bool passed, const char* actual) {
+  checks++;
+  if (passed) return;
+  failures++;
+  const native_fakes::CivilTime c = native_fakes::CivilFromSeconds(t);
+  printf("%04u-%02u-%02u %02u:%02u:%02u: line %d: expected %s, got %s\n",
+         c.year, c.month, c.date, c.hours, c.minutes, c.seconds, line.number,
+         line.arg.c_str(), actual);
+}
+
+void Execute(const Line& line, int64_t t) {
+  switch (line.command) {
+    case kKeys:
+      typing_done = ScheduleKeys(line.arg.c_str(), millis());
+      break;
+    case kExpect:
+      Check(line, t, state == line.arg, state.c_str());
+      break;
+    case kExpectPlay: {
+      const uint8_t file = native_fakes::Mp3()->playingFile();
+      char actual[4];
+      snprintf(actual, sizeof(actual), "%u", file);
+      Check(line, t, file == strtoul(line.arg.c_str(), nullptr, 10), actual);
+      break;
+    }
+    case kStickBus:
+      native_fakes::StickBus(strtoul(line.arg.c_str(), nullptr, 10));
+      break;
+    case kUnplug:
+      native_fakes::Unplug(strtoul(line.arg.c_str(), nullptr, 16));
+      break;
+    case kPlug:
+      native_fakes::Plug(strtoul(line.arg.c_str(), nullptr, 16));
+      break;
+  }
+}
+
+} // namespace
+
+unsigned long ScheduleKeys(const char* keys, unsigned long t) {
+  for (const char* k = keys; *k != '\0'; k++) {
+    const char key = *k;
+    if (key == '.') {
+      t += 1000;
+      continue;
+    }
+    if (key == 's') {
+      native_fakes::At(t, []() {
+        PressButton(kStopButtonPin, kButtonTapMillis);
+      });
+    } else if (key == 'S') {
+      native_fakes::At(t, []() {
+        PressButton(kStopButtonPin, kButtonHoldMillis);
+      });
+    } else if (key == 'z') {
+      native_fakes::At(t, []() {
+        PressButton(kSnoozeButtonPin, kButtonTapMillis);
+      });
+    } else {
+      native_fakes::At(t, [key]() { native_fakes::PressKey(key); });
+    }
+    t += kKeyIntervalMillis;
+  }
+  return t + kButtonHoldMillis;
+}
+
+bool Load(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (f == nullptr) {
+    perror(path);
+    return false;
+  }
+  char buf[256];
+  int number = 0;
+  bool ok = true;
+  while (ok && fgets(buf, sizeof(buf), f) != nullptr) {
+    number++;
+    size_t length = strlen(buf);
+    while (length > 0 && strchr(" \t\r\n", buf[length - 1]) != nullptr) {
+      buf[--length] = '\0';
+    }
+    const char* p = buf + strspn(buf, " \t");
+    if (*p == '\0' || *p == '#') continue;
+    if (!ParseLine(p, number)) {
+      fprintf(stderr, "%s:%d: can't parse \"%s\"\n", path, number, p);
+      ok = false;
+    }
+  }
+  fclose(f);
+  if (ok && (start_seconds < 0 || end_seconds < start_seconds)) {
+    fprintf(stderr, "%s: needs a start, and an end after it\n", path);
+    ok = false;
+  }
+  return ok;
+}
+
+int64_t StartSeconds() {
+  return start_seconds;
+}
+
+int Run() {
+  const auto host_start = std::chrono::steady_clock::now();
+  RV1805* rtc = native_fakes::Rtc();
+  MP3TRIGGER* mp3 = native_fakes::Mp3();
+  native_fakes::CaptureSerial([](const char* line) {
+    static const char kPrefix[] = "Transitioning to ";
+    if (strncmp(line, kPrefix, sizeof(kPrefix) - 1) == 0) {
+      state = line + sizeof(kPrefix) - 1;
+      transitions++;
+    }
+  });
+  const uint32_t plays_before = mp3->playCount();
+
+  // From the start, rather than from now, so that lines at the start time
+  // still run, however long setup() took.
+  for (Line& line : lines) line.next = NextRun(line, start_seconds);
+  unsigned long loops = 0;
+  while (true) {
+    Line* line = nullptr;
+    for (Line& l : lines) {
+      if (line == nullptr || l.next < line->next) line = &l;
+    }
+    if (line == nullptr || line->next >= end_seconds) break;
+    const int64_t target = line->next;
+
+    while ((millis() < typing_done || mp3->playingFile() != 0) &&
+           rtc->Now() < target) {
+      loop();
+      loops++;
+    }
+    // The skip stops at each event on the way, in case it's the RTC's alarm,
+    // which wakes the firmware up just like on the bench.
+    while (rtc->Now() < target - kLeadSeconds) {
+      const uint64_t now = native_fakes::Micros();
+      const uint64_t skip_to = std::min(
+          now + static_cast<uint64_t>(target - kLeadSeconds - rtc->Now()) *
+                    1000000,
+          std::max(native_fakes::NextEventMicros(), now));
+      native_fakes::SkipMicros(skip_to - now);
+      if (native_fakes::GetPin(kRtcInterruptPin)) continue;
+      const int64_t awake_until = std::min(rtc->Now() + kLeadSeconds, target);
+      while ((rtc->Now() < awake_until || mp3->playingFile() != 0) &&
+             rtc->Now() < target) {
+        loop();
+        loops++;
+      }
+    }
+    while (rtc->Now() < target) {
+      loop();
+      loops++;
+    }
+    Execute(*line, target);
+    line->next = NextRun(*line, target + 1);
+  }
+
+  const auto host_elapsed = std::chrono::steady_clock::now() - host_start;
+  printf("%u checks, %u failed; %u transitions, %u files played; "
+         "%.1f days in %.0f ms (host), %lu loops\n",
+         checks, failures, transitions,
+         mp3->playCount() - plays_before,
+         static_cast<double>(end_seconds - start_seconds) / kSecondsPerDay,
+         std::chrono::duration<double, std::milli>(host_elapsed).count(),
+         loops);
+  return failures == 0 ? 0 : 1;
+}
+
+} // namespace simulation
@@ -0,0 +1,64 @@
+// vim: sts=2 sw=2 fdm=syntax
+#pragma once
+
+// Scripted runs of the firmware over days, weeks or years of RTC time.
+//
+// A scenario is a text file of lines like these:
+//
+//   start 2026-01-04 06:00:00
+//   end 2027-01-04 00:00:00
+//   2026-01-04 06:00:00 keys 13#*8885.0700.*
+//   Mon 07:00:01 expect SOUNDING
+//   Mon 07:00:01 expect-play 1
+//   Mon 07:00:05 keys s
+//   daily 07:00:06 expect WAITING
+//
+// `start` is what the RTC reads when the firmware starts, and the run stops
+// at `end`. Every other line is a time, and a command to run at that time:
+// a date and time runs once, `daily` runs every day, and a weekday name
+// (Sun-Sat) runs every week. The commands are:
+//
+//   keys <keys>        types <keys>, as in native_main's -k option
+//   expect <STATE>     checks that the last "Transitioning to <STATE>" line
+//                      on Serial named <STATE> (WAITING, before any)
+//   expect-play <n>    checks that the MP3 trigger is playing file <n>, or
+//                      nothing if <n> is 0
+//   stick-bus <n>      makes a device hold SDA low until SCL has been pulsed
+//                      <n> times (see native_fakes::StickBus)
+//   unplug <addr>      stops the device at I2C address <addr> (in hex) from
+//   plug <addr>        answering, or lets it answer again
+//
+// Lines that start with '#' are comments.
+//
+// Between the times the scenario mentions, the simulation skips the virtual
+// clock forward rather than running the firmware through every millisecond,
+// which is what lets it cover a year in well under a second. The firmware
+// sleeps until the RTC's alarm or its next clock read anyway; the skip just
+// doesn't bother running Timer0 along the way. It stops when the RTC's alarm
+// goes off, though, and runs the firmware for a couple of seconds (or until
+// it stops playing a file), so alarms go off on time between the times the
+// scenario mentions too. Nothing is skipped while keys
+// are still being typed or a file is playing, and the firmware runs for a
+// couple of seconds before each line's time, so keys, sounds and menus take
+// as long as they always do.
+
+#include <stdint.h>
+
+namespace simulation {
+
+// Types `keys` on the keypad and arcade buttons, one every 300 ms starting at
+// millis() == `t`: 0-9, * and # are keypad keys, 's' and 'z' tap the stop and
+// snooze buttons, 'S' holds the stop button down for 3 seconds, and '.'
+// waits a second. Returns when the last key will have been released.
+unsigned long ScheduleKeys(const char* keys, unsigned long t);
+
+// Reads a scenario. Prints what's wrong and returns false if it can't.
+bool Load(const char* path);
+// The start time from the scenario, in seconds since 2000.
+int64_t StartSeconds();
+// Runs the loaded scenario from where setup() left off. Prints every failed
+// check and a summary, and returns the process exit status: 0 if every
+// check passed.
+int Run();
+
+} // namespace simulation
@@ -19,8 +19,21 @@
 #include <SparkFun_Qwiic_MP3_Trigger_Arduino_Library.h>
 #include <SparkFun_Qwiic_Keypad_Arduino_Library.h>
 #include <SerLCD.h>
+#include <ctype.h>
 #include <stdio.h>
+#include <util/crc16.h>
+#include "alarm_clock.h"
+#include "debouncer.h"
 #include "double_high_digits.h"
+#include "eeprom_journal.h"
+#include "i2c_stats.h"
+#include "mp3_catalog.h"
+#include "mp3_service.h"
+#include "profiler.h"
+#include "ram_monitor.h"
+#include "ring_buffer.h"
+#include "scheduler.h"
+#include "shadow_lcd.h"
 
 /* I2C addresses:
     0x37: MP3
@@ -29,50 +42,6 @@
     0x72: SerLCD
 */
 
-enum GlobalState {
-  WAITING,
-  SNOOZING,
-  SOUNDING,
-  SOUNDING_SHABBAT,
-};
-
-enum TimeState {
-  INACTIVE,
-  ACTIVE,
-  SKIP_NEXT,
-  SHABBAT,
-  kMaxTimeState,
-};
-
-struct Time {
-  uint8_t hours24;
-  uint8_t minutes;
-  uint8_t hours12() const;
-  const char* amPMString() const;
-  TimeState state = INACTIVE;
-  Time& operator+=(int minutes);
-  static Time FromClock();
-  bool operator==(const Time& other) const {
-    return hours24 == other.hours24 && minutes == other.minutes;
-  }
-  bool operator<(const Time& other) const {
-    if (hours24 < other.hours24) {
-      return true;
-    }
-    if (hours24 == other.hours24) {
-      return minutes < other.minutes;
-    }
-    return false;
-  }
-};
-
-
-struct PersistentSettings {
-  Time alarms[7];
-  bool alarms_off;
-  int snooze_length;
-};
-
 // Things are organized into namespaces to allow irrelevant sections
 // of the code to be folded up when I'm not coding on one of them.
 // The use of multiple namespaces was easier than splitting this project
@@ -83,156 +52,168 @@ struct PersistentSettings {
 
 namespace menu {
 
-char ReadChar();
-bool InputTime(Time& result);
-int InputWeekday();
-
-struct Item {
-  // Called when the user enters this menu item, or after handling a keypress.
-  virtual void Display() const {}
-  // Handle is used to handle any keypress that's not
-  // up/down/exit navigation (which are enforced by
-  // menu::Run for menu UI consistency).
-  // This function doesn't have to return immediately.
-  // It can implement its own UI and read more
-  // keypresses itself before returning.
-  virtual void Handle(char) const {}
-  // Called when the user navigates off of this menu item.
-  virtual void Leave() const {}
-};
-
-struct SetClock : public Item {
-  void Display() const override;
-  void Handle(char c) const override;
-};
-
-struct AllAlarms : public Item {
-  void Display() const override;
-  void Handle(char c) const override;
-};
-
-struct SetAlarm : public Item {
-    SetAlarm(int day):day_(day){}
-    void Display() const override;
-    void Handle(char c) const override;
-  private:
-    int day_;
+// Called with the item's arg and what the user entered.
+typedef void (*DateDone)(uint8_t arg, uint8_t year, uint8_t month,
+                         uint8_t date);
+typedef void (*DaysDone)(uint8_t arg, uint8_t days);
+typedef void (*TimeDone)(uint8_t arg, const Time& time);
+void InputDate(const __FlashStringHelper* prompt, DateDone done);
+void InputDays(uint8_t days, DaysDone done);
+void InputTime(TimeDone done);
+
+// How 4 and 6 step a value past the ends of its range.
+enum Bounds : uint8_t {
+  kClamp,
+  kWrap,
 };
 
-struct SoundSettings : public Item {
-  void Display() const override;
-  void Handle(char c) const override;
-  void Leave() const override;
-};
-
-struct SoundTest : public Item {
-    SoundTest(int num):num_(num){}
-    void Display() const override;
-    void Handle(char c) const override;
-    void Leave() const override;
-  private:
-    int num_;
-};
-
-struct SnoozeLength : public Item {
-  void Display() const override;
-  void Handle(char c) const override;
+// One screen of the menu. The menu is a table of these in flash, which Run()
+// interprets: 2 and 8 (or 0) move between items, * and # leave the menu, 4
+// and 6 step the item's value down and up, and every other key is passed to
+// the item's handle function. Any field may be nullptr.
+struct Item {
+  // printf format for the first line, given arg.
+  const char* label;
+  // Draws the rest of the item, given arg and the current value.
+  void (*format)(uint8_t arg, uint8_t value);
+  // The value that 4 and 6 adjust, between min and max inclusive.
+  uint8_t (*get)(uint8_t arg);
+  void (*set)(uint8_t arg, uint8_t value);
+  uint8_t min;
+  uint8_t max;
+  Bounds bounds;
+  // Called after every keypress that isn't navigation. To ask for more input,
+  // it can start InputDate, InputDays or InputTime, which call back once
+  // the user has entered it.
+  void (*handle)(uint8_t arg, char c);
+  // Called when the user navigates off of this item.
+  void (*leave)(uint8_t arg);
+  // Passed to all of the above, e.g. the slot of an alarm.
+  uint8_t arg;
+  // Whether the item is in the menu at the moment. Navigation skips over the
+  // items it returns false for.
+  bool (*shown)(uint8_t arg);
 };
 
 bool CheckPasswordChar(char c);
 
-
-void Run(const Item** items, int n);
-
-const Item* main[] = {
-  new SetClock,
-  new AllAlarms,
-  new SetAlarm(0),
-  new SetAlarm(1),
-  new SetAlarm(2),
-  new SetAlarm(3),
-  new SetAlarm(4),
-  new SetAlarm(5),
-  new SetAlarm(6),
-  new SnoozeLength,
-  new SoundSettings,
-  new SoundTest(1),
-  new SoundTest(2),
-};
-
-constexpr int kMainLength = sizeof(main) / sizeof(Item*);
+bool IsOpen();
+void Open();
+void Step(char c);
+void Close();
 
 } // namespace menu
 
 namespace statemachine {
 
-void TransitionStateTo(GlobalState new_state);
-void ExtendSnooze();
-void ToggleSkipped();
-void MaybeResetSkipped();
-bool AlarmNow();
-void Handle();
-void HandleForMillis(unsigned long ms);
+void TransitionStateTo(GlobalState new_state, const ClockSnapshot& now);
+void ExtendSnooze(const ClockSnapshot& now);
+void ToggleSkipped(const ClockSnapshot& now);
+void ToggleAlarmsOff(const ClockSnapshot& now);
+void ClockSet(const ClockSnapshot& now);
+bool AlarmsDone(const ClockSnapshot& now);
+bool Passed(uint16_t from, uint16_t elapsed, uint16_t target, uint16_t period);
+uint8_t AlarmSound(const Alarm& alarm, bool shabbat);
+void AlarmTimePassed(Alarm& alarm, bool holiday, const ClockSnapshot& now);
+void AlarmMinutePassed(uint16_t minute_of_week, const ClockSnapshot& now);
+void MinutesPassed(const ClockSnapshot& now, uint16_t from, uint16_t elapsed);
+void SetRtcAlarm();
+void HandleButton(const debouncer::Event& e, const ClockSnapshot& now);
+void Handle(const ClockSnapshot& now);
 } // namespace statemachine
 
 namespace display {
-void PrintTimeTall();
+void PrintTimeTall(const ClockSnapshot& now);
 void PrintNextAlarm();
-void PrintShabbatStatus();
+void PrintShabbatStatus(const ClockSnapshot& now);
 void ClearStatusArea();
 } // namespace display
 
-using ISR = void (*)();
-
-class Button {
-  uint8_t pin;
-  volatile unsigned long lastInterruptTime = 0;
-  volatile bool pressed = false;
-
-  static constexpr unsigned long kDebounceTimeMillis = 1000;
-
-  public:
-
-  explicit Button(uint8_t pin):pin(pin){}
-
-  void begin(ISR isr) {
-    pinMode(pin, INPUT_PULLUP);
-    attachInterrupt(digitalPinToInterrupt(pin), isr, FALLING);
-  }
-
-  bool isPressed() {
-    return !digitalRead(pin);
-  }
-
-  bool checkAndClear() {
-    bool p = pressed;
-    pressed = false;
-    return p;
-  }
+// The I2C bus, and the health of the devices on it.
+namespace bus {
+void Begin();
+void BeginDevice(i2c_stats::Device device);
+bool Check(i2c_stats::Device device);
+bool IsDown(i2c_stats::Device device);
+void Poll();
+void Report();
+} // namespace bus
+
+// The periodic jobs that the main loop runs through task_scheduler, each at
+// its own rate.
+namespace tasks {
+
+// In the order they run within a pass.
+enum Id : uint8_t {
+  kBus,
+  kClock,
+  kSound,
+  kKeypad,
+  kStateMachine,
+  kDisplay,
+  kConsole,
+  kMemory,
+  kNumTasks,
+};
 
-  void handleInterrupt() {
-    unsigned long now = millis();
-    if (now - lastInterruptTime > kDebounceTimeMillis) {
-      pressed = true;
-    }
-    lastInterruptTime = now;
-  }
+void ReadClock();
+void PollSound();
+void SoundFinished(uint8_t file);
+void ReadKeypad();
+void RunStateMachine();
+void RefreshDisplay();
+char TakeKey();
+bool HasKey();
+void ClockChanged();
+void SampleRam();
+} // namespace tasks
+
+// Commands typed on the USB serial port, one per line.
+namespace console {
+void Poll();
+void Execute(const char* line);
+} // namespace console
+
+// The arcade buttons, wired between their pins and GND.
+enum ButtonId : uint8_t {
+  kStopButton,
+  kSnoozeButton,
+  kNumButtons,
 };
+constexpr uint8_t kButtonPins[kNumButtons] = {2, 3};
+// Arcade button contacts stop bouncing within a few milliseconds.
+constexpr uint8_t kDebounceMillis = 5;
+constexpr uint16_t kLongPressMillis = 2000;
 
 
 int operator-(const Time& t, const Time& u);
 int WriteToPrint(char c, FILE* f);
 FILE* OpenAsFile(Print& p);
-Time& TodaysAlarm();
-int NextAlarmDay();
+void FormatDays(uint8_t days, char (&out)[8]);
 
-Button stop_button(2);
-Button snooze_button(3);
+// Sampled by the Timer0 compare interrupt.
+debouncer::Debouncer<kNumButtons> buttons(kDebounceMillis, kLongPressMillis);
 KEYPAD keypad;
+// The keypad's and the RTC's INT lines. They're on pin change interrupts,
+// because pins 2 and 3 (the only ones with external interrupts) are taken by
+// the buttons.
+constexpr uint8_t kKeypadInterruptPin = 4;
+constexpr uint8_t kRtcInterruptPin = 5;
 MP3TRIGGER mp3;
+// Everything except setup() and the console's diagnostics goes through sound,
+// rather than talking to mp3 directly.
+mp3_service::Service<MP3TRIGGER> sound(mp3);
+// How many of the card's files the menu shows the names of. Each name costs
+// 9 bytes of RAM.
+constexpr uint8_t kNamedSounds = 8;
+// Read when the trigger starts, so that choosing a sound (or playing one)
+// never has to ask it what's on the card.
+mp3_catalog::Catalog<MP3TRIGGER, kNamedSounds> catalog(mp3);
 RV1805 rtc;
 
 SerLCD lcd;
+// All drawing goes to screen, and reaches the LCD at the next screen.flush().
+shadow_lcd::Buffer<SerLCD> screen(lcd);
 FILE* lcd_file;
 
 // Weekdays are numbered 0-6 on the RV1805
@@ -246,18 +227,47 @@ const char* kDayNames[] = {
   "Sat"
 };
 
+// FormatDays() marks each weekday with its initial, or '-' if it's not set.
+const char kDayLetters[] PROGMEM = "SMTWTFS";
+
 
 GlobalState state;
 Time snooze;
 Time alarm_stop;
 PersistentSettings persistent_settings;
+// The latest reading of the RTC. Until there is one, 2000-01-01, a Saturday.
+ClockSnapshot clock_now = {0, 1, 6, 1, 0, 0, 0, 0};
+AlarmIndex alarm_index;
+NextAlarm next_alarm;
+scheduler::Scheduler<tasks::kNumTasks> task_scheduler;
+
+// Timer0 runs millis(), and also interrupts on compare match A once per
+// overflow, i.e. every 1.024 ms.
+ISR(TIMER0_COMPA_vect) {
+  const unsigned long now = millis();
+  bool queued = false;
+  for (uint8_t i = 0; i < kNumButtons; i++) {
+    queued |= buttons.sample(i, digitalRead(kButtonPins[i]) == LOW, now);
+  }
+  if (queued) task_scheduler.Wake(tasks::kStateMachine);
+}
 
-void snoozeButtonISR() {
-  snooze_button.handleInterrupt();
+// Pins 0-7 share this vector, but only kKeypadInterruptPin and
+// kRtcInterruptPin are enabled. Neither device can be read from here, since
+// Wire needs interrupts.
+ISR(PCINT2_vect) {
+  if (digitalRead(kKeypadInterruptPin) == LOW) {
+    task_scheduler.Wake(tasks::kKeypad);
+  }
+  if (digitalRead(kRtcInterruptPin) == LOW) {
+    task_scheduler.Wake(tasks::kClock);
+  }
 }
 
-void stopButtonISR() {
-  stop_button.handleInterrupt();
+void EnablePinChangeInterrupt(uint8_t pin) {
+  pinMode(pin, INPUT_PULLUP);
+  *digitalPinToPCMSK(pin) |= bit(digitalPinToPCMSKbit(pin));
+  PCICR |= bit(digitalPinToPCICRbit(pin));
 }
 
 
@@ -267,39 +277,249 @@ int WriteToPrint(char c, FILE* f) {
   return p->print(c);
 }
 
+// stdio hands a FILE's output over one character at a time. lcd_file is
+// opened on screen rather than on lcd, so those characters only land in
+// screen's RAM copy of the display; what reaches the bus is decided at
+// screen.flush(), one write per changed row. Don't open a FILE directly on
+// the SerLCD: every character would be an I2C transaction and a 10 ms delay.
 FILE* OpenAsFile(Print& p) {
   FILE* f = fdevopen(WriteToPrint, nullptr);
   fdev_set_udata(f, &p);
   return f;
 }
 
-int NextAlarmDay() {
-  if (persistent_settings.alarms_off) return -1;
-  int today = rtc.getWeekday();
-  if (TodaysAlarm() < Time::FromClock()) {
-    today = (today + 1) % 7;
+#if defined(ALARM_CLOCK_I2C_STATS) && defined(ARDUINO_ARCH_AVR)
+// Every transaction the Wire library makes, for any device library, ends up
+// in one of these two functions from its twi.c. The uno_instrumented build
+// links with --wrap for both, so calls land here instead.
+extern "C" {
+uint8_t __real_twi_writeTo(uint8_t address, uint8_t* data, uint8_t length,
+                           uint8_t wait, uint8_t sendStop);
+uint8_t __real_twi_readFrom(uint8_t address, uint8_t* data, uint8_t length,
+                            uint8_t sendStop);
+
+uint8_t __wrap_twi_writeTo(uint8_t address, uint8_t* data, uint8_t length,
+                           uint8_t wait, uint8_t sendStop) {
+  const unsigned long start = micros();
+  const uint8_t result =
+      __real_twi_writeTo(address, data, length, wait, sendStop);
+  i2c_stats::Record(address, length, micros() - start);
+  return result;
+}
+
+uint8_t __wrap_twi_readFrom(uint8_t address, uint8_t* data, uint8_t length,
+                            uint8_t sendStop) {
+  const unsigned long start = micros();
+  const uint8_t result = __real_twi_readFrom(address, data, length, sendStop);
+  i2c_stats::Record(address, length, micros() - start);
+  return result;
+}
+} // extern "C"
+#endif
+
+#ifdef ARDUINO_ARCH_AVR
+// Paints all of the RAM above the static variables for ram_monitor, before
+// anything has used it. It runs from .init3, after the stack pointer and
+// __zero_reg__ are set up and before main(), so it can't call anything, and
+// being naked, it falls through into the next section instead of returning.
+// volatile keeps the compiler from turning the loop into a call to memset().
+void PaintRam() __attribute__((naked, used, section(".init3")));
+void PaintRam() {
+  for (volatile uint8_t* p = &__heap_start;
+       p <= reinterpret_cast<uint8_t*>(RAMEND); p++) {
+    *p = ram_monitor::kPaint;
+  }
+}
+#endif
+
+// Writes a string like "-MTWTF-".
+void FormatDays(uint8_t days, char (&out)[8]) {
+  for (uint8_t d = 0; d < 7; d++) {
+    out[d] = days & bit(d) ? pgm_read_byte(&kDayLetters[d]) : '-';
+  }
+  out[7] = '\0';
+}
+
+// Years count from 2000, like the RV1805's.
+uint8_t DaysInMonth(uint8_t year, uint8_t month) {
+  static const uint8_t kDays[12] PROGMEM = {
+    31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31,
+  };
+  // 2000 was a leap year, and 2100 is out of the RV1805's range.
+  if (month == 2 && year % 4 == 0) return 29;
+  return pgm_read_byte(&kDays[month - 1]);
+}
+
+uint16_t DaysInYear(uint8_t year) {
+  return year % 4 == 0 ? 366 : 365;
+}
+
+// 0-6, Sunday first, like the RV1805's weekday register.
+uint8_t Weekday(uint8_t year, uint8_t month, uint8_t date) {
+  static const uint8_t kMonthOffsets[12] PROGMEM = {
+    0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4,
+  };
+  // Sakamoto's method, which counts January and February as the end of the
+  // previous year.
+  const uint16_t y = year + 2000 - (month < 3);
+  return (y + y / 4 - y / 100 + y / 400 +
+          pgm_read_byte(&kMonthOffsets[month - 1]) + date) % 7;
+}
+
+Date Date::From(uint8_t year, uint8_t month, uint8_t date) {
+  Date d = {year, static_cast<uint16_t>(date - 1)};
+  for (uint8_t m = 1; m < month; m++) d.day_of_year += DaysInMonth(year, m);
+  return d;
+}
+
+void Date::toMonthDate(uint8_t* month, uint8_t* date) const {
+  uint16_t left = day_of_year;
+  uint8_t m = 1;
+  while (left >= DaysInMonth(year, m)) left -= DaysInMonth(year, m++);
+  *month = m;
+  *date = left + 1;
+}
+
+Date& Date::operator+=(int days) {
+  int d = day_of_year + days;
+  while (d < 0) d += DaysInYear(--year);
+  while (d >= static_cast<int>(DaysInYear(year))) d -= DaysInYear(year++);
+  day_of_year = d;
+  return *this;
+}
+
+constexpr int kMinutesPerDay = 24 * 60;
+constexpr int kMinutesPerWeek = 7 * kMinutesPerDay;
+
+// An insertion sort, since there are at most kMaxAlarms, and they're
+// usually in order already.
+void AlarmIndex::Sort() {
+  length_ = 0;
+  for (uint8_t slot = 0; slot < kMaxAlarms; slot++) {
+    const Alarm& alarm = persistent_settings.alarms[slot];
+    if (alarm.days == 0) continue;
+    uint8_t i = length_++;
+    for (; i > 0 && alarm.time < persistent_settings.alarms[order_[i - 1]].time;
+         i--) {
+      order_[i] = order_[i - 1];
+    }
+    order_[i] = slot;
   }
-  for (int i = 0; i < 7; i++) {
-    int cur_day = (today + i) % 7;
-    if (persistent_settings.alarms[cur_day].state != INACTIVE) {
-      return cur_day;
+}
+
+uint8_t AlarmIndex::LowerBound(uint16_t minute_of_day) const {
+  uint8_t lo = 0;
+  uint8_t hi = length_;
+  while (lo < hi) {
+    const uint8_t mid = (lo + hi) / 2;
+    if (persistent_settings.alarms[order_[mid]].time.minuteOfDay() <
+        minute_of_day) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+bool AlarmIndex::Find(uint16_t minute_of_week, uint8_t skip_days,
+                      uint8_t* slot, uint16_t* minutes_until) const {
+  const uint8_t weekday = minute_of_week / kMinutesPerDay;
+  const uint16_t minute_of_day = minute_of_week % kMinutesPerDay;
+  const uint8_t first = LowerBound(minute_of_day);
+  // The rest of today, the following six days, and then today again, up to
+  // minute_of_day.
+  for (uint8_t d = 0; d <= 7; d++) {
+    if (skip_days & bit(d)) continue;
+    const uint8_t day_bit = bit((weekday + d) % 7);
+    const uint8_t begin = d == 0 ? first : 0;
+    const uint8_t end = d == 7 ? first : length_;
+    for (uint8_t i = begin; i < end; i++) {
+      const Alarm& alarm = persistent_settings.alarms[order_[i]];
+      if (!(alarm.days & day_bit) || alarm.time.state == INACTIVE) continue;
+      *slot = order_[i];
+      *minutes_until =
+          d * kMinutesPerDay + alarm.time.minuteOfDay() - minute_of_day;
+      return true;
     }
   }
-  return -1;
+  return false;
+}
+
+void NextAlarm::Recompute(const ClockSnapshot& now) {
+  minute_of_week_ = now.MinuteOfWeek();
+  day = -1;
+  if (persistent_settings.alarms_off) return;
+  // Once this minute's alarms have gone off, the next one is a later one.
+  const uint8_t skip = statemachine::AlarmsDone(now) ? 1 : 0;
+  const uint16_t from = (minute_of_week_ + skip) % kMinutesPerWeek;
+  // One lookup per day in the calendar, for the days Find() looks through.
+  Date first = now.day();
+  if (from / kMinutesPerDay != now.weekday) first += 1;
+  uint8_t days_off = 0;
+  for (uint8_t d = 0; d <= 7; d++) {
+    Date date = first;
+    date += d;
+    if (calendar::IsSet(calendar::kOff, date)) days_off |= bit(d);
+  }
+  uint16_t until;
+  if (!alarm_index.Find(from, days_off, &slot, &until)) return;
+  time = persistent_settings.alarms[slot].time;
+  minutes_until = until + skip;
+  day = (minute_of_week_ + minutes_until) / kMinutesPerDay % 7;
+  Date date = first;
+  date += (from % kMinutesPerDay + until) / kMinutesPerDay;
+  if (time.state == ACTIVE && calendar::IsSet(calendar::kHoliday, date)) {
+    time.state = SHABBAT;
+  }
 }
 
-Time& TodaysAlarm() {
-  return persistent_settings.alarms[rtc.getWeekday()];
+void NextAlarm::Tick(const ClockSnapshot& now) {
+  if (day == -1) return;
+  const uint16_t minute_of_week = now.MinuteOfWeek();
+  minutes_until -=
+      (minute_of_week - minute_of_week_ + kMinutesPerWeek) % kMinutesPerWeek;
+  minute_of_week_ = minute_of_week;
+  if (minutes_until < 0) Recompute(now);
 }
 
-Time Time::FromClock() {
+Time ClockSnapshot::time() const {
   Time t;
-  t.hours24 = rtc.getHours();
-  t.minutes = rtc.getMinutes();
+  t.hours24 = hours24;
+  t.minutes = minutes;
   t.state = ACTIVE;
   return t;
 }
 
+Date ClockSnapshot::day() const {
+  return Date::From(year, month, date);
+}
+
+uint16_t ClockSnapshot::MinuteOfWeek() const {
+  return (weekday * 24 + hours24) * 60 + minutes;
+}
+
+bool ClockSnapshot::Take(ClockSnapshot* snapshot) {
+  if (!rtc.updateTime()) return false;
+  ClockSnapshot s;
+  s.year = rtc.getYear();
+  s.month = rtc.getMonth();
+  s.weekday = rtc.getWeekday();
+  s.date = rtc.getDate();
+  s.hours24 = rtc.getHours();
+  s.minutes = rtc.getMinutes();
+  s.seconds = rtc.getSeconds();
+  s.millis = ::millis();
+  // A garbled read would index kDayNames and the calendar with it.
+  if (s.weekday >= 7 || s.hours24 >= 24 || s.minutes >= 60 ||
+      s.seconds >= 60 || s.month < 1 || s.month > 12 || s.date < 1 ||
+      s.date > 31) {
+    return false;
+  }
+  *snapshot = s;
+  return true;
+}
+
 Time& Time::operator+=(int minutes) {
   this->minutes += minutes;
   if (this->minutes >= 60) {
@@ -341,571 +561,1055 @@ const char* Time::amPMString() const {
 namespace menu {
 
 constexpr unsigned long kMenuTimeoutMillis = 1 * 60 * 1000UL;
+constexpr unsigned long kMessageMillis = 1000;
+
+// What the menu does with the next keypress.
+enum Mode : uint8_t {
+  kClosed,
+  // Moving between items, and adjusting them.
+  kItems,
+  kInputDate,
+  kInputDays,
+  kInputTime,
+  // Showing an error message, until message_end. Keypresses are ignored.
+  kMessage,
+};
+
+Mode mode = kClosed;
 unsigned long lastInputTime = 0;
+// The item being shown, copied out of flash.
+uint8_t cur;
+Item item;
+// The digits of the date or time being entered.
+char input[8];
+uint8_t input_length;
+// What the date being entered is for, e.g. "From".
+const __FlashStringHelper* date_prompt;
+// The weekdays being picked, as in Alarm::days.
+uint8_t input_days;
+DateDone date_done;
+DaysDone days_done;
+TimeDone time_done;
+const __FlashStringHelper* message;
+unsigned long message_end;
 
 bool IsExitChar(char c) {
   return c == '*' || c == '#';
 }
 
-// Waits for a keypress on the keypad, and returns the
-// keypress. While it waits, it handles statemachine events.
-// Returns an ExitChar if the menu has been waiting too long since the last
-// keypress. This eventually gets us back to showing the clock (though it may
-// take multiple calls to ReadChar to exit nested input flows.)
-char ReadChar() {
-  while (1) {
-    if (millis() - lastInputTime > kMenuTimeoutMillis) {
-      return '*';
-      // If you're in a text entry field, it may take multiple cancels to get
-      // back to the clock screen. But we don't reset lastInputTime, so
-      // subsequent calls to ReadChar will also timeout until we're back at the
-      // main clock screen.
-    }
-    delay(50);
-    keypad.updateFIFO();
-    if (keypad.getButton() != 0) {
-      lastInputTime=millis();
-      return keypad.getButton();
-    }
-    statemachine::Handle();
-  }
+// prompt is at most 4 characters.
+void InputDate(const __FlashStringHelper* prompt, DateDone done) {
+  date_prompt = prompt;
+  date_done = done;
+  input_length = 0;
+  mode = kInputDate;
 }
 
+// Starts from days, which the keys 1-7 toggle.
+void InputDays(uint8_t days, DaysDone done) {
+  input_days = days;
+  days_done = done;
+  mode = kInputDays;
+}
 
-int InputWeekday() {
-  lcd.clear();
-  lcd.println(F("Enter Weekday"));
-  lcd.print(F("1=Sun -- 7=Sat"));
-  char c = ReadChar();
-  if ('1' <= c && c <= '7') {
-    return c - '1';
-  }
-  lcd.clear();
-  lcd.println(F("Invalid time."));
-  statemachine::HandleForMillis(1000);
-  return -1;
-}
-
-bool InputTime(Time& result) {
-  lcd.clear();
-  lcd.println(F("Time HH:MM"));
-  lcd.setCursor(0, 1);
-  lcd.println(F("#=< (24 hours)"));
-  lcd.blink();
-  lcd.setCursor(5, 0);
-  char c[3];
-  c[2] = 0;
-
-  c[0] = ReadChar();
-  if (IsExitChar(c[0])) {
-    lcd.noBlink();
-    return false;
-  }
-  lcd.print(c[0]);
+void InputTime(TimeDone done) {
+  time_done = done;
+  input_length = 0;
+  mode = kInputTime;
+}
 
-  c[1] = ReadChar();
-  if (IsExitChar(c[1])) {
-    lcd.noBlink();
-    return false;
-  }
-  lcd.print(c[1]);
-  lcd.print(':');
+void ShowMessage(const __FlashStringHelper* m) {
+  message = m;
+  message_end = millis() + kMessageMillis;
+  mode = kMessage;
+}
 
-  uint8_t hours24 = atoi(c);
+uint8_t InputNumber(uint8_t i) {
+  return (input[i] - '0') * 10 + (input[i + 1] - '0');
+}
 
-  c[0] = ReadChar();
-  if (IsExitChar(c[0])) {
-    lcd.noBlink();
-    return false;
+// 8 digits, YYYYMMDD, from 2000 through 2099 like the RV1805.
+void HandleDateKey(char c) {
+  if (IsExitChar(c)) {
+    mode = kItems;
+    return;
   }
-  lcd.print(c[0]);
-
-  c[1] = ReadChar();
-  if (IsExitChar(c[1])) {
-    lcd.noBlink();
-    return false;
+  if (c < '0' || c > '9') return;
+  input[input_length++] = c;
+  if (input_length < 8) return;
+  mode = kItems;
+  const uint8_t year = InputNumber(2);
+  const uint8_t month = InputNumber(4);
+  const uint8_t date = InputNumber(6);
+  if (InputNumber(0) != 20 || month < 1 || month > 12 || date < 1 ||
+      date > DaysInMonth(year, month)) {
+    ShowMessage(F("Invalid date."));
+    return;
   }
-  lcd.print(c[1]);
+  date_done(item.arg, year, month, date);
+}
 
-  uint8_t minutes = atoi(c);
-  lcd.noBlink();
+// Unlike the other prompts, # finishes it rather than cancelling it.
+void HandleDaysKey(char c) {
+  if ('1' <= c && c <= '7') {
+    input_days ^= bit(c - '1');
+    return;
+  }
+  if (c == '*') mode = kItems;
+  if (c != '#') return;
+  mode = kItems;
+  days_done(item.arg, input_days);
+}
 
+void HandleTimeKey(char c) {
+  if (IsExitChar(c)) {
+    mode = kItems;
+    return;
+  }
+  if (c < '0' || c > '9') return;
+  input[input_length++] = c;
+  if (input_length < 4) return;
+  mode = kItems;
+  const uint8_t hours24 = InputNumber(0);
+  const uint8_t minutes = InputNumber(2);
   if (hours24 >= 24 || minutes >= 60) {
-    lcd.clear();
-    lcd.println(F("Invalid time."));
-    statemachine::HandleForMillis(1000);
-    return false;
+    ShowMessage(F("Invalid time."));
+    return;
   }
-
-  result.hours24 = hours24;
-  result.minutes = minutes;
-  return true;
+  Time t;
+  t.hours24 = hours24;
+  t.minutes = minutes;
+  time_done(item.arg, t);
 }
 
-void SetAlarm::Display() const {
-  const Time& time = persistent_settings.alarms[day_];
-  lcd.clear();
-
+// Shows an alarm for one day as "Mon  7:00 am", and one for several as
+// "-MTWTF-  7:00 am".
+void FormatAlarm(uint8_t slot, uint8_t state) {
+  const Alarm& alarm = persistent_settings.alarms[slot];
+  if (alarm.days == 0) {
+    screen.print(F("New alarm"));
+    screen.setCursor(0, 1);
+    screen.print(F("5=Set"));
+    return;
+  }
+  char days[8];
+  FormatDays(alarm.days, days);
+  // A single day gets its name instead.
+  if ((alarm.days & (alarm.days - 1)) == 0) {
+    for (uint8_t d = 0; d < 7; d++) {
+      if (alarm.days == bit(d)) strcpy(days, kDayNames[d]);
+    }
+  }
+  const Time& time = alarm.time;
   fprintf_P(lcd_file, PSTR("%s %2d:%02d %s\r\n"),
-            kDayNames[day_], time.hours12(), time.minutes, time.amPMString());
-  switch (time.state) {
+            days, time.hours12(), time.minutes, time.amPMString());
+  switch (state) {
     case INACTIVE:
-      lcd.print(F("Inactive"));
+      screen.print(F("Inactive"));
       break;
     case ACTIVE:
-      lcd.print(F("Active"));
+      screen.print(F("Active"));
       break;
     case SKIP_NEXT:
-      lcd.print(F("Skip Next"));
+      screen.print(F("Skip Next"));
       break;
     case SHABBAT:
-      lcd.print(F("Shabbat"));
-      break;
-    case kMaxTimeState:
-      lcd.print(F("BUG: kMaxTimeState"));
+      screen.print(F("Shabbat"));
       break;
   }
+  if (alarm.sound != 0) {
+    screen.setCursor(11, 1);
+    fprintf_P(lcd_file, PSTR("F%03d"), alarm.sound);
+  }
 }
 
-void SetAlarm::Handle(char c) const {
-  Time& alarm = persistent_settings.alarms[day_];
-  if (c == '5') {
-    if (InputTime(alarm) && alarm.state != SHABBAT) {
-      alarm.state = ACTIVE;
-    }
+uint8_t GetAlarmState(uint8_t slot) {
+  return persistent_settings.alarms[slot].time.state;
+}
+
+void SetAlarmState(uint8_t slot, uint8_t state) {
+  Alarm& alarm = persistent_settings.alarms[slot];
+  if (alarm.days == 0) return;
+  alarm.time.state = static_cast<TimeState>(state);
+}
+
+void AlarmTimeEntered(uint8_t slot, const Time& t) {
+  Time& time = persistent_settings.alarms[slot].time;
+  time.hours24 = t.hours24;
+  time.minutes = t.minutes;
+  if (time.state != SHABBAT) {
+    time.state = ACTIVE;
   }
-  if (c == '4') {
-    int new_state = static_cast<int>(alarm.state) - 1;
-    if (new_state < 0) {
-      new_state = kMaxTimeState - 1;
-    }
-    alarm.state = static_cast<TimeState>(new_state);
+  alarm_index.Sort();
+}
+
+// No days at all deletes the alarm. A new alarm goes on to ask for its time.
+void AlarmDaysEntered(uint8_t slot, uint8_t days) {
+  Alarm& alarm = persistent_settings.alarms[slot];
+  const bool is_new = alarm.days == 0;
+  if (days == 0) {
+    alarm = Alarm();
+  } else {
+    alarm.days = days;
+  }
+  alarm_index.Sort();
+  if (is_new && days != 0) InputTime(AlarmTimeEntered);
+}
+
+// Plays sound number num, unless an alarm is sounding.
+void PlaySound(uint8_t num) {
+  if (state == SOUNDING || state == SOUNDING_SHABBAT) return;
+  sound.play(num);
+}
+
+// Stops a sound started from the menu, but not an alarm.
+void StopSound(uint8_t) {
+  if (state != SOUNDING && state != SOUNDING_SHABBAT) {
+    sound.stop();
   }
-  if (c == '6') {
-    int new_state = static_cast<int>(alarm.state) + 1;
-    if (new_state >= kMaxTimeState) {
-      new_state = 0;
+}
+
+// 5 sets the time, and 9 the days. A new alarm needs its days first. 7 steps
+// through the files on the card, playing each, and then back to the usual
+// sound.
+void HandleAlarm(uint8_t slot, char c) {
+  Alarm& alarm = persistent_settings.alarms[slot];
+  if (c == '9' || (c == '5' && alarm.days == 0)) {
+    InputDays(alarm.days, AlarmDaysEntered);
+  } else if (c == '5') {
+    InputTime(AlarmTimeEntered);
+  } else if (c == '7' && alarm.days != 0) {
+    alarm.sound = alarm.sound < catalog.count() ? alarm.sound + 1 : 0;
+    if (alarm.sound != 0) {
+      PlaySound(alarm.sound);
+    } else {
+      StopSound(slot);
     }
-    alarm.state = static_cast<TimeState>(new_state);
   }
 }
 
-void SetClock::Display() const {
-  Time t = Time::FromClock();
-  lcd.setCursor(0, 0);
-  lcd.println(F("Set Clock"));
+// The alarms in use, followed by the first unused slot, for adding one.
+bool AlarmShown(uint8_t slot) {
+  if (persistent_settings.alarms[slot].days != 0) return true;
+  for (uint8_t s = 0; s < slot; s++) {
+    if (persistent_settings.alarms[s].days == 0) return false;
+  }
+  return true;
+}
+
+void PrintDate(uint8_t year, uint8_t month, uint8_t date) {
+  fprintf_P(lcd_file, PSTR("20%02d-%02d-%02d"), year, month, date);
+}
+
+void FormatClock(uint8_t, uint8_t) {
+  screen.print(F("Clock "));
+  PrintDate(clock_now.year, clock_now.month, clock_now.date);
+  screen.setCursor(0, 1);
+  Time t = clock_now.time();
   fprintf_P(lcd_file, PSTR(" %s %2d:%02d %s"),
-            kDayNames[rtc.getWeekday()],
+            kDayNames[clock_now.weekday],
             t.hours12(),
             t.minutes,
             t.amPMString());
 }
 
-void SetClock::Handle(char c) const {
-  if (c != '5') return;
-  int d = InputWeekday();
-  if (d == -1) return;
-  Time t;
-  if (!InputTime(t)) return;
-  rtc.setTime(0, 0, t.minutes, t.hours24, 1, 1, 2000, d);
+// Between entering the date and the time.
+uint8_t clock_year;
+uint8_t clock_month;
+uint8_t clock_date;
+
+// The weekday follows from the date, and the calendar needs the date to be
+// right.
+void ClockTimeEntered(uint8_t, const Time& t) {
+  rtc.setTime(0, 0, t.minutes, t.hours24, clock_date, clock_month,
+              clock_year + 2000, Weekday(clock_year, clock_month, clock_date));
+  tasks::ClockChanged();
 }
 
-void AllAlarms::Display() const {
-  if (persistent_settings.alarms_off) {
-    lcd.println(F("Alarm Disabled"));
-  } else {
-    lcd.println(F("Alarm Enabled"));
-  }
+void ClockDateEntered(uint8_t, uint8_t year, uint8_t month, uint8_t date) {
+  clock_year = year;
+  clock_month = month;
+  clock_date = date;
+  InputTime(ClockTimeEntered);
 }
 
-void AllAlarms::Handle(char c) const {
-  if (c == '4' || c == '5' || c == '6') {
-    persistent_settings.alarms_off = !persistent_settings.alarms_off;
-  }
+void HandleClock(uint8_t, char c) {
+  if (c == '5') InputDate(F("Date"), ClockDateEntered);
 }
 
-void SoundSettings::Display() const {
-  fprintf_P(lcd_file, PSTR("4/6 Volume: %d\r\n"), mp3.getVolume());
-  lcd.print("7/9 Eq: ");
-  byte eq = mp3.getEQ();
-  if (eq == 0) {
-    lcd.print(F("Normal"));
-  }
-  if (eq == 1) {
-    lcd.print(F("Pop"));
-  }
-  if (eq == 2) {
-    lcd.print(F("Rock"));
-  }
-  if (eq == 3) {
-    lcd.print(F("Jazz"));
-  }
-  if (eq == 4) {
-    lcd.print(F("Classic"));
-  }
-  if (eq == 5) {
-    lcd.print(F("Bass"));
+// The next run of days with the item's flag, or how to add one.
+void FormatCalendar(uint8_t flag, uint8_t) {
+  const Date today = clock_now.day();
+  Date from = today;
+  Date to;
+  if (!calendar::NextRange(static_cast<calendar::Flag>(flag), today, &from,
+                           &to)) {
+    screen.print(F("5=Set 9=Clear"));
+    return;
   }
+  uint8_t month, date;
+  from.toMonthDate(&month, &date);
+  screen.print(F("Next "));
+  PrintDate(from.year, month, date);
 }
 
-void SoundSettings::Handle(const char c) const {
-  if (state != SOUNDING && state != SOUNDING_SHABBAT && !mp3.isPlaying()) {
-    mp3.playFile(1);
-    Serial.println(mp3.getStatus());
-    // Status codes: 0 = OK, 1 = Fail, 2 = No such file, 5 = SD Error.
-    Serial.println(mp3.hasCard());
-    Serial.println(mp3.getSongCount());
-    Serial.println(mp3.getSongName());
-  }
-  if (c == '4') {
-    mp3.setVolume(mp3.getVolume() - 1);
-  }
-  if (c == '6') {
-    mp3.setVolume(mp3.getVolume() + 1);
-  }
-  if (c == '7') {
-    byte eq = mp3.getEQ();
-    if (eq == 0) return;
-    mp3.setEQ(eq - 1);
-  }
-  if (c == '9') {
-    byte newEq = mp3.getEQ() + 1;
-    if (newEq > 5) newEq = 5;
-    mp3.setEQ(newEq);
+// Between entering the first and the last date of a range.
+Date range_from;
+// Whether the range is being set or cleared.
+bool range_on;
+
+// Takes effect right away, rather than when the menu closes: the calendar
+// isn't part of persistent_settings.
+void CalendarToEntered(uint8_t flag, uint8_t year, uint8_t month,
+                       uint8_t date) {
+  const Date to = Date::From(year, month, date);
+  if (!calendar::InRange(to, clock_now.day()) || to < range_from) {
+    ShowMessage(F("Invalid date."));
+    return;
   }
+  calendar::SetRange(static_cast<calendar::Flag>(flag), range_from, to,
+                     range_on);
 }
 
-void SoundSettings::Leave() const {
-  if (state != SOUNDING && state != SOUNDING_SHABBAT) {
-    mp3.stop();
+void CalendarFromEntered(uint8_t, uint8_t year, uint8_t month,
+                         uint8_t date) {
+  range_from = Date::From(year, month, date);
+  if (!calendar::InRange(range_from, clock_now.day())) {
+    ShowMessage(F("This year/next."));
+    return;
   }
+  InputDate(F("To"), CalendarToEntered);
 }
 
-void SoundTest::Display() const {
-  fprintf_P(lcd_file, PSTR("Test F%03d.mp3\r\n"), num_);
-  lcd.println(F("4=Stop 6=Play"));
+// 5 sets a range of days, from one date through another, and 9 clears one.
+void HandleCalendar(uint8_t, char c) {
+  if (c != '5' && c != '9') return;
+  range_on = c == '5';
+  InputDate(F("From"), CalendarFromEntered);
 }
 
-void SoundTest::Handle(const char c) const {
-  if (state == SOUNDING || state == SOUNDING_SHABBAT) return;
-  if (c == '6') {
-    mp3.playFile(num_);
-    Serial.println(mp3.getStatus());
-    // Status codes: 0 = OK, 1 = Fail, 2 = No such file, 5 = SD Error.
-    Serial.println(mp3.hasCard());
-    Serial.println(mp3.getSongCount());
-    Serial.println(mp3.getSongName());
-  }
-  if (c=='4') {
-    mp3.stop();
+void FormatEnabled(uint8_t, uint8_t enabled) {
+  if (enabled) {
+    screen.print(F("Enabled"));
+  } else {
+    screen.print(F("Disabled"));
   }
 }
 
-void SoundTest::Leave() const {
-  if (state != SOUNDING && state != SOUNDING_SHABBAT) {
-    mp3.stop();
-  }
+uint8_t GetAlarmsEnabled(uint8_t) {
+  return !persistent_settings.alarms_off;
 }
 
-void SnoozeLength::Display() const {
-  fprintf_P(lcd_file, PSTR("Snooze: %d min"), persistent_settings.snooze_length);
+void SetAlarmsEnabled(uint8_t, uint8_t enabled) {
+  persistent_settings.alarms_off = !enabled;
 }
 
-void SnoozeLength::Handle(char c) const {
-  if (c == '4') {
-    persistent_settings.snooze_length--;
-    if (persistent_settings.snooze_length < 1) {
-      persistent_settings.snooze_length=1;
-    }
-  }
-  if (c == '6') {
-    persistent_settings.snooze_length++;
-    if (persistent_settings.snooze_length > 20) {
-      persistent_settings.snooze_length=20;
-    }
-  }
+void FormatNumber(uint8_t, uint8_t value) {
+  screen.print(value);
 }
 
+void FormatMinutes(uint8_t, uint8_t minutes) {
+  fprintf_P(lcd_file, PSTR("%d min"), minutes);
+}
 
-void Run(const Item** items, const int n) {
-  lastInputTime = millis();
-  lcd.setFastBacklight(0, 255, 127);
-  int cur = 0;
-  while (true) {
-    lcd.clear();
-    items[cur]->Display();
-    const char c = ReadChar();
-    if (IsExitChar(c)) {
-      items[cur]->Leave();
-      break;
-    }
-    if (c == '2' || c == '8' || c == '0') {
-      int old_cur = cur;
-      if (c == '2') cur--;
-      if (c == '8' || c == '0') cur++;
-      if (cur < 0) cur = 0;
-      if (cur >= n) cur = n - 1;
-      if (old_cur != cur) items[old_cur]->Leave();
-      continue;
-    }
-    items[cur]->Handle(c);
-  }
-  lcd.clear();
-  lcd.setFastBacklight(255, 0, 0);
+uint8_t GetSnoozeLength(uint8_t) {
+  return persistent_settings.snooze_length;
 }
 
-// Accepts password input one key at a time, and returns true when the password
-// has been entered correctly. If the last len(password) keypresses are the
-// correct password, then the password is accepted. If you started to enter the
-// wrong password, or hit random keys before entering the correct password,
-// there's no need to clear the input before hitting the correct password.
-bool CheckPasswordChar(char c) {
-  // The password should not have any repeated digits, otherwise we might need
-  // a Knuth-Morris-Pratt matcher to check it, which would complicate this code
-  // significantly.
-  static const char kPassword[5] PROGMEM = "13#*";
-  static unsigned state = 0;
-  const char firstChar = pgm_read_byte(kPassword);
-  const char nextChar = pgm_read_byte(kPassword + state);
-  if (nextChar == c) {
-    state++;
-    if (state == strlen_P(kPassword)) {
-      state = 0;
-      return true;
-    }
-    return false;
-  } else if (firstChar == c) {
-    state = 1;
-    return false;
-  } else {
-    state = 0;
-    return false;
-  }
+void SetSnoozeLength(uint8_t, uint8_t minutes) {
+  persistent_settings.snooze_length = minutes;
 }
 
+uint8_t GetVolume(uint8_t) {
+  return sound.volume();
+}
 
-} // namespace menu
+void SetVolume(uint8_t, uint8_t volume) {
+  sound.setVolume(volume);
+}
 
-namespace statemachine {
+const char kEqNames[][8] PROGMEM = {
+  "Normal",
+  "Pop",
+  "Rock",
+  "Jazz",
+  "Classic",
+  "Bass",
+};
 
-void ExtendSnooze() {
-  if (snooze.state != ACTIVE) {
-    snooze = Time::FromClock();
-  }
-  snooze.state = ACTIVE;
-  snooze += persistent_settings.snooze_length;
+void FormatEq(uint8_t, uint8_t eq) {
+  screen.print(reinterpret_cast<const __FlashStringHelper*>(kEqNames[eq]));
+}
 
+uint8_t GetEq(uint8_t) {
+  return sound.eq();
 }
 
-void TransitionStateTo(GlobalState new_state) {
-  if (new_state == state) {
+void SetEq(uint8_t, uint8_t eq) {
+  sound.setEq(eq);
+}
+
+// Keeps the alarm sound playing while the volume or EQ is adjusted, so that
+// you can hear the difference.
+void PlaySample(uint8_t, char) {
+  if (!sound.playing()) PlaySound(1);
+}
+
+// The file the sounds item shows, from 1.
+uint8_t browse_file = 1;
+
+// Everything it shows comes from catalog, rather than from the trigger.
+void FormatSounds(uint8_t, uint8_t) {
+  if (catalog.count() == 0) {
+    screen.println(F("Sounds"));
+    screen.setCursor(0, 1);
+    screen.print(F("No SD card"));
     return;
   }
-  if (state == SOUNDING_SHABBAT) {
-    Serial.println(F("Transitioning from SOUNDING_SHABBAT"));
-    snooze_button.checkAndClear();
-    stop_button.checkAndClear();
-  }
-  if (state == SOUNDING || state == SOUNDING_SHABBAT) {
-    Serial.println(F("Transitioning from SOUNDING"));
-    mp3.stop();
-    alarm_stop.state = INACTIVE;
-  }
-  if (state == SNOOZING) {
-    Serial.println(F("Transitioning from SNOOZING"));
-    snooze.state = INACTIVE;
+  if (browse_file > catalog.count()) browse_file = 1;
+  fprintf_P(lcd_file, PSTR("Sound %d of %d\r\n"), browse_file,
+            catalog.count());
+  const char* name = catalog.name(browse_file);
+  if (name != nullptr) screen.print(name);
+  screen.setCursor(10, 1);
+  screen.print(F("5=Play"));
+}
+
+// 4 and 6 step through the files, and 5 plays or stops the one shown.
+void HandleSounds(uint8_t, char c) {
+  const uint8_t count = catalog.count();
+  if (count == 0) return;
+  if (c == '4' || c == '6') {
+    browse_file = c == '6' ? browse_file % count + 1
+                           : (browse_file + count - 2) % count + 1;
+    if (sound.playing()) PlaySound(browse_file);
+  } else if (c == '5') {
+    if (sound.file() == browse_file) {
+      StopSound(0);
+    } else {
+      PlaySound(browse_file);
+    }
   }
+}
 
-  state = new_state;
+// Only the ATmega has a budget to show.
+bool RamShown(uint8_t) {
+  return ram_monitor::kMeasured;
+}
 
-  if (new_state == WAITING) {
-    Serial.println(F("Transitioning to WAITING"));
-  }
-  if (new_state == SOUNDING) {
+void FormatRam(uint8_t, uint8_t) {
+  fprintf_P(lcd_file, PSTR("RAM %u free\r\n"), ram_monitor::FreeNow());
+  fprintf_P(lcd_file, PSTR("%u never used"), ram_monitor::NeverUsed());
+}
+
+const char kAlarmsLabel[] PROGMEM = "Alarms";
+const char kDaysOffLabel[] PROGMEM = "Days off";
+const char kHolidaysLabel[] PROGMEM = "Holidays";
+const char kSnoozeLabel[] PROGMEM = "Snooze";
+const char kVolumeLabel[] PROGMEM = "Volume";
+const char kEqLabel[] PROGMEM = "Eq";
+
+#define ALARM_ITEM(slot) \
+  {nullptr, FormatAlarm, GetAlarmState, SetAlarmState, 0, kMaxTimeState - 1, \
+   kWrap, HandleAlarm, StopSound, slot, AlarmShown}
+
+const Item main[] PROGMEM = {
+  {nullptr, FormatClock, nullptr, nullptr, 0, 0,
+   kClamp, HandleClock, nullptr, 0, nullptr},
+  {kAlarmsLabel, FormatEnabled, GetAlarmsEnabled, SetAlarmsEnabled, 0, 1,
+   kWrap, nullptr, nullptr, 0, nullptr},
+  // One for each of the kMaxAlarms slots.
+  ALARM_ITEM(0),
+  ALARM_ITEM(1),
+  ALARM_ITEM(2),
+  ALARM_ITEM(3),
+  ALARM_ITEM(4),
+  ALARM_ITEM(5),
+  ALARM_ITEM(6),
+  ALARM_ITEM(7),
+  ALARM_ITEM(8),
+  ALARM_ITEM(9),
+  ALARM_ITEM(10),
+  ALARM_ITEM(11),
+  ALARM_ITEM(12),
+  ALARM_ITEM(13),
+  {kDaysOffLabel, FormatCalendar, nullptr, nullptr, 0, 0,
+   kClamp, HandleCalendar, nullptr, calendar::kOff, nullptr},
+  {kHolidaysLabel, FormatCalendar, nullptr, nullptr, 0, 0,
+   kClamp, HandleCalendar, nullptr, calendar::kHoliday, nullptr},
+  {kSnoozeLabel, FormatMinutes, GetSnoozeLength, SetSnoozeLength, 1, 20,
+   kClamp, nullptr, nullptr, 0, nullptr},
+  {kVolumeLabel, FormatNumber, GetVolume, SetVolume, 0, 31,
+   kClamp, PlaySample, StopSound, 0, nullptr},
+  {kEqLabel, FormatEq, GetEq, SetEq, 0, 5,
+   kClamp, PlaySample, StopSound, 0, nullptr},
+  {nullptr, FormatSounds, nullptr, nullptr, 0, 0,
+   kClamp, HandleSounds, StopSound, 0, nullptr},
+  {nullptr, FormatRam, nullptr, nullptr, 0, 0,
+   kClamp, nullptr, nullptr, 0, RamShown},
+};
+
+#undef ALARM_ITEM
+
+constexpr uint8_t kMainLength = sizeof(main) / sizeof(Item);
+
+bool IsShown(uint8_t i) {
+  Item it;
+  memcpy_P(&it, &main[i], sizeof(Item));
+  return it.shown == nullptr || it.shown(it.arg);
+}
+
+void DrawItem() {
+  if (item.label != nullptr) {
+    fprintf_P(lcd_file, item.label, item.arg);
+    screen.setCursor(0, 1);
+  }
+  const uint8_t value = item.get != nullptr ? item.get(item.arg) : 0;
+  if (item.format != nullptr) item.format(item.arg, value);
+}
+
+void DrawInputTime() {
+  screen.println(F("Time HH:MM"));
+  screen.setCursor(0, 1);
+  screen.println(F("#=< (24 hours)"));
+  screen.setCursor(5, 0);
+  for (uint8_t i = 0; i < input_length; i++) {
+    screen.print(input[i]);
+    if (i == 1) screen.print(':');
+  }
+  screen.blink();
+}
+
+void DrawInputDate() {
+  screen.print(date_prompt);
+  screen.setCursor(5, 0);
+  screen.println(F("YYYY-MM-DD"));
+  screen.setCursor(0, 1);
+  screen.println(F("#=<"));
+  screen.setCursor(5, 0);
+  for (uint8_t i = 0; i < input_length; i++) {
+    screen.print(input[i]);
+    if (i == 3 || i == 5) screen.print('-');
+  }
+  screen.blink();
+}
+
+void DrawInputDays() {
+  char days[8];
+  FormatDays(input_days, days);
+  fprintf_P(lcd_file, PSTR("Days %s\r\n"), days);
+  screen.print(F("1=Sun 7=Sat #=OK"));
+}
+
+void Draw() {
+  screen.clear();
+  screen.noBlink();
+  switch (mode) {
+    case kClosed:
+      break;
+    case kItems:
+      DrawItem();
+      break;
+    case kInputDate:
+      DrawInputDate();
+      break;
+    case kInputDays:
+      DrawInputDays();
+      break;
+    case kInputTime:
+      DrawInputTime();
+      break;
+    case kMessage:
+      screen.println(message);
+      break;
+  }
+  screen.flush();
+}
+
+void Adjust(int delta) {
+  int value = item.get(item.arg) + delta;
+  if (value < item.min) value = item.bounds == kWrap ? item.max : item.min;
+  if (value > item.max) value = item.bounds == kWrap ? item.min : item.max;
+  item.set(item.arg, value);
+}
+
+void Leave() {
+  if (item.leave != nullptr) item.leave(item.arg);
+}
+
+void HandleItemKey(char c) {
+  if (IsExitChar(c)) {
+    Close();
+    return;
+  }
+  if (c == '2' || c == '8' || c == '0') {
+    int new_cur = cur;
+    do {
+      if (c == '2') new_cur--;
+      if (c == '8' || c == '0') new_cur++;
+      if (new_cur < 0 || new_cur >= kMainLength) return;
+    } while (!IsShown(new_cur));
+    Leave();
+    cur = new_cur;
+    memcpy_P(&item, &main[cur], sizeof(Item));
+    return;
+  }
+  if (item.get != nullptr && (c == '4' || c == '6')) {
+    Adjust(c == '6' ? 1 : -1);
+  }
+  if (item.handle != nullptr) item.handle(item.arg, c);
+}
+
+bool IsOpen() {
+  return mode != kClosed;
+}
+
+void Open() {
+  lastInputTime = millis();
+  // The menu owns the screen until it closes.
+  task_scheduler.Enable(tasks::kDisplay, false);
+  screen.setFastBacklight(0, 255, 127);
+  cur = 0;
+  memcpy_P(&item, &main[cur], sizeof(Item));
+  mode = kItems;
+  Draw();
+}
+
+// Called from loop() on every pass while the menu is open, with the
+// keypress that arrived since the last pass, or 0. Handles at most that one
+// keypress, and never waits.
+void Step(char c) {
+  if (millis() - lastInputTime > kMenuTimeoutMillis) {
+    // Wherever we are in the menu, even halfway through entering a time.
+    Close();
+    return;
+  }
+  if (mode == kMessage) {
+    if (static_cast<long>(millis() - message_end) < 0) return;
+    mode = kItems;
+    Draw();
+    return;
+  }
+  if (c == 0) return;
+  lastInputTime = millis();
+  switch (mode) {
+    case kItems:
+      HandleItemKey(c);
+      break;
+    case kInputDate:
+      HandleDateKey(c);
+      break;
+    case kInputDays:
+      HandleDaysKey(c);
+      break;
+    case kInputTime:
+      HandleTimeKey(c);
+      break;
+    default:
+      break;
+  }
+  if (mode != kClosed) Draw();
+}
+
+// Also saves the settings, which may have changed.
+void Close() {
+  Leave();
+  mode = kClosed;
+  screen.noBlink();
+  screen.clear();
+  screen.setFastBacklight(255, 0, 0);
+  task_scheduler.Enable(tasks::kDisplay, true);
+  task_scheduler.Wake(tasks::kDisplay);
+  storage::Save();
+  next_alarm.Recompute(clock_now);
+  task_scheduler.Wake(tasks::kStateMachine);
+}
+
+// Accepts password input one key at a time, and returns true when the password
+// has been entered correctly. If the last len(password) keypresses are the
+// correct password, then the password is accepted. If you started to enter the
+// wrong password, or hit random keys before entering the correct password,
+// there's no need to clear the input before hitting the correct password.
+bool CheckPasswordChar(char c) {
+  // The password should not have any repeated digits, otherwise we might need
+  // a Knuth-Morris-Pratt matcher to check it, which would complicate this code
+  // significantly.
+  static const char kPassword[5] PROGMEM = "13#*";
+  static unsigned state = 0;
+  const char firstChar = pgm_read_byte(kPassword);
+  const char nextChar = pgm_read_byte(kPassword + state);
+  if (nextChar == c) {
+    state++;
+    if (state == strlen_P(kPassword)) {
+      state = 0;
+      return true;
+    }
+    return false;
+  } else if (firstChar == c) {
+    state = 1;
+    return false;
+  } else {
+    state = 0;
+    return false;
+  }
+}
+
+
+} // namespace menu
+
+namespace statemachine {
+
+// The MP3 file that SOUNDING plays: the one for the alarm that went off
+// last, which snoozing it plays again.
+uint8_t alarm_sound = kAlarmSound;
+
+void ExtendSnooze(const ClockSnapshot& now) {
+  if (snooze.state != ACTIVE) {
+    snooze = now.time();
+  }
+  snooze.state = ACTIVE;
+  snooze += persistent_settings.snooze_length;
+
+}
+
+void TransitionStateTo(GlobalState new_state, const ClockSnapshot& now) {
+  if (new_state == state) {
+    return;
+  }
+  if (state == SOUNDING_SHABBAT) {
+    Serial.println(F("Transitioning from SOUNDING_SHABBAT"));
+  }
+  if (state == SOUNDING || state == SOUNDING_SHABBAT) {
+    Serial.println(F("Transitioning from SOUNDING"));
+    sound.stop();
+    alarm_stop.state = INACTIVE;
+  }
+  if (state == SNOOZING) {
+    Serial.println(F("Transitioning from SNOOZING"));
+    snooze.state = INACTIVE;
+  }
+
+  state = new_state;
+  next_alarm.Recompute(now);
+  task_scheduler.Wake(tasks::kDisplay);
+
+  if (new_state == WAITING) {
+    Serial.println(F("Transitioning to WAITING"));
+  }
+  if (new_state == SOUNDING) {
     Serial.println(F("Transitioning to SOUNDING"));
-    mp3.playFile(1);
+    sound.play(alarm_sound);
   }
   if (new_state == SOUNDING_SHABBAT) {
     Serial.println(F("Transitioning to SOUNDING_SHABBAT"));
-    mp3.playFile(2);
+    sound.play(alarm_sound);
   }
   if (new_state == SNOOZING) {
     Serial.println(F("Transitioning to SNOOZING"));
-    ExtendSnooze();
+    ExtendSnooze(now);
   }
 }
 
-void ToggleSkipped() {
-  int day = NextAlarmDay();
-  if (day == -1) return;
-  Time& t = persistent_settings.alarms[day];
-  if (t.state == ACTIVE) t.state = SKIP_NEXT;
-  else if (t.state == SKIP_NEXT) t.state = ACTIVE;
-  EEPROM.put(0, persistent_settings);
-}
-
-void MaybeResetSkipped() {
-  Time& alarm = TodaysAlarm();
-  Time now = Time::FromClock();
-  // rtc.getSeconds() == 59 is used to ensure that resetting skipped alarms
-  // happens only after they would have triggered, had they not been skipped.
-  // Triggering (in AlarmNow) only happens when rtc.getSeconds() == 0.
-  if (alarm == now && alarm.state == SKIP_NEXT && rtc.getSeconds() == 59) {
-    alarm.state = ACTIVE;
-    EEPROM.put(0, persistent_settings);
-  }
-}
-
-bool AlarmNow() {
-  const Time& alarm = TodaysAlarm();
-  return !persistent_settings.alarms_off &&
-         (alarm.state == ACTIVE || alarm.state == SHABBAT) &&
-         alarm == Time::FromClock() &&
-         rtc.getSeconds() == 0;
-  // If the user stops the alarm within 1
-  // minute of it triggering, it is still true that
-  // time == Time::FromClock(), and we've returned
-  // to the WAITING state, so the alarm will just start
-  // sounding again. The check for rtc.getSeconds() == 0
-  // prevents that by only allowing us to start the alarm
-  // in the first second of the minute. I think it's safe to
-  // assume that the user won't react within one second.
-}
-
-void Handle() {
-  rtc.updateTime();
-  Time now = Time::FromClock();
-  MaybeResetSkipped();
-  if (state == WAITING) {
-    bool alarm_now = AlarmNow();
-    if (alarm_now && TodaysAlarm().state == ACTIVE) {
-      TransitionStateTo(SOUNDING);
-    } else if (alarm_now && TodaysAlarm().state == SHABBAT) {
-      TransitionStateTo(SOUNDING_SHABBAT);
-    }  else if (stop_button.checkAndClear()) {
-      ToggleSkipped();
-    } else if (snooze_button.checkAndClear()) {
-      TransitionStateTo(SNOOZING);
-    }
-  } else if (state == SNOOZING) {
-    if (snooze == now) {
-      TransitionStateTo(SOUNDING);
-    } else if (stop_button.checkAndClear()) {
-      TransitionStateTo(WAITING);
-    } else if (snooze_button.checkAndClear()) {
-      ExtendSnooze();
+// Every alarm at the next alarm's minute that day, which can be more than
+// one: skipping the next alarm means the clock stays quiet then.
+void ToggleSkipped(const ClockSnapshot& now) {
+  if (next_alarm.day == -1) return;
+  const TimeState from = persistent_settings.alarms[next_alarm.slot].time.state;
+  const TimeState to = from == ACTIVE ? SKIP_NEXT : ACTIVE;
+  const uint16_t minute_of_day = next_alarm.time.minuteOfDay();
+  for (uint8_t i = alarm_index.LowerBound(minute_of_day);
+       i < alarm_index.length(); i++) {
+    Alarm& alarm = persistent_settings.alarms[alarm_index[i]];
+    if (alarm.time.minuteOfDay() != minute_of_day) break;
+    if ((alarm.days & bit(next_alarm.day)) && alarm.time.state == from &&
+        (from == ACTIVE || from == SKIP_NEXT)) {
+      alarm.time.state = to;
     }
-  } else if (state == SOUNDING) {
-    if (!mp3.isPlaying()) {
-      TransitionStateTo(WAITING);
-    } else if (stop_button.checkAndClear()) {
-      mp3.stop();
-      TransitionStateTo(WAITING);
-    } else if (snooze_button.checkAndClear()) {
-      TransitionStateTo(SNOOZING);
+  }
+  storage::Save();
+  next_alarm.Recompute(now);
+  task_scheduler.Wake(tasks::kDisplay);
+}
+
+void ToggleAlarmsOff(const ClockSnapshot& now) {
+  persistent_settings.alarms_off = !persistent_settings.alarms_off;
+  Serial.println(persistent_settings.alarms_off ? F("Alarms disabled")
+                                                : F("Alarms enabled"));
+  storage::Save();
+  next_alarm.Recompute(now);
+  task_scheduler.Wake(tasks::kDisplay);
+}
+
+// Alarms and snoozes go off when the clock passes their time, rather than
+// when Handle() happens to see the first second of their minute, so that a
+// slow pass through loop() can't make the clock miss one.
+constexpr uint16_t kNoMinute = 0xFFFF;
+// The minute of the week that Handle() last saw.
+uint16_t last_minute = kNoMinute;
+// The day and minute of the day of the last alarm that went off (or had its
+// skip used up), so that setting the clock back past it doesn't make it, or
+// any earlier one that day, go off twice. The day is the alarm's own, which
+// is yesterday for a 23:59 alarm that the clock first saw at midnight.
+Date alarm_done_day = {0xFF, 0};
+uint16_t alarm_done_minute = 0;
+
+// Setting the clock isn't time passing: jumping it over an alarm's time
+// doesn't set the alarm off.
+void ClockSet(const ClockSnapshot& now) {
+  last_minute = now.MinuteOfWeek();
+}
+
+// Whether a clock that moved forward `elapsed` minutes from `from` passed
+// `target` on the way (or reached it). Minutes count modulo `period`, which
+// is a day or a week.
+bool Passed(uint16_t from, uint16_t elapsed, uint16_t target,
+            uint16_t period) {
+  const uint16_t ahead = (target + period - from % period) % period;
+  return ahead == 0 ? elapsed >= period : ahead <= elapsed;
+}
+
+// The alarm's own sound, if the card has it, or else the usual one.
+uint8_t AlarmSound(const Alarm& alarm, bool shabbat) {
+  if (catalog.has(alarm.sound)) return alarm.sound;
+  return shabbat ? kShabbatSound : kAlarmSound;
+}
+
+// On a holiday, an ACTIVE alarm goes off as a shabbat alarm, with the
+// shabbat sound unless it has its own.
+void AlarmTimePassed(Alarm& alarm, bool holiday, const ClockSnapshot& now) {
+  TimeState& alarm_state = alarm.time.state;
+  if (alarm_state == SKIP_NEXT) {
+    // This was the alarm that was skipped. The next one isn't.
+    alarm_state = ACTIVE;
+    storage::Save();
+    next_alarm.Recompute(now);
+    task_scheduler.Wake(tasks::kDisplay);
+  } else if (persistent_settings.alarms_off || state != WAITING) {
+    return;
+  } else if (alarm_state == ACTIVE && !holiday) {
+    alarm_sound = AlarmSound(alarm, false);
+    TransitionStateTo(SOUNDING, now);
+  } else if (alarm_state == ACTIVE || alarm_state == SHABBAT) {
+    alarm_sound = AlarmSound(alarm, true);
+    TransitionStateTo(SOUNDING_SHABBAT, now);
+  }
+}
+
+// Whether the alarms at now's minute have gone off already.
+bool AlarmsDone(const ClockSnapshot& now) {
+  return now.day() == alarm_done_day &&
+         now.time().minuteOfDay() <= alarm_done_minute;
+}
+
+// Every alarm at that minute of the week, which can be more than one.
+void AlarmMinutePassed(uint16_t minute_of_week, const ClockSnapshot& now) {
+  const uint8_t weekday = minute_of_week / kMinutesPerDay;
+  const uint8_t day_bit = bit(weekday);
+  const uint16_t minute_of_day = minute_of_week % kMinutesPerDay;
+  // Today's, unless the clock has passed midnight since that minute.
+  Date day = now.day();
+  day += -((now.weekday + 7 - weekday) % 7);
+  if (day == alarm_done_day && minute_of_day <= alarm_done_minute) return;
+  alarm_done_day = day;
+  alarm_done_minute = minute_of_day;
+  // On a day off, even a skip doesn't get used up.
+  if (calendar::IsSet(calendar::kOff, day)) return;
+  const bool holiday = calendar::IsSet(calendar::kHoliday, day);
+  for (uint8_t i = alarm_index.LowerBound(minute_of_day);
+       i < alarm_index.length(); i++) {
+    Alarm& alarm = persistent_settings.alarms[alarm_index[i]];
+    if (alarm.time.minuteOfDay() != minute_of_day) break;
+    if (alarm.days & day_bit) AlarmTimePassed(alarm, holiday, now);
+  }
+}
+
+void MinutesPassed(const ClockSnapshot& now, uint16_t from,
+                   uint16_t elapsed) {
+  // Steps from one alarm's minute to the next, through the minutes after
+  // from, which is usually just the one.
+  uint16_t minute = (from + 1) % kMinutesPerWeek;
+  uint16_t left = elapsed;
+  uint8_t slot;
+  uint16_t ahead;
+  while (alarm_index.Find(minute, 0, &slot, &ahead) && ahead < left) {
+    minute = (minute + ahead) % kMinutesPerWeek;
+    AlarmMinutePassed(minute, now);
+    minute = (minute + 1) % kMinutesPerWeek;
+    left -= ahead + 1;
+  }
+  if (state == SNOOZING &&
+      Passed(from, elapsed, snooze.hours24 * 60 + snooze.minutes,
+             kMinutesPerDay)) {
+    TransitionStateTo(SOUNDING, now);
+  }
+}
+
+// The time the RTC's alarm is set to, or INACTIVE if it's off.
+Time rtc_alarm;
+
+// Sets the RTC's alarm to the next time that Handle() will have something to
+// do: the end of the snooze, or the next alarm (even a skipped one, whose
+// skip gets used up then). The alarm interrupt wakes the clock task at that
+// time, however far the millis() timing of its once a minute readings has
+// drifted from the RTC by then.
+void SetRtcAlarm() {
+  Time t;
+  if (state == SNOOZING) {
+    t = snooze;
+  } else if (next_alarm.day != -1) {
+    t = next_alarm.time;
+    t.state = ACTIVE;
+  }
+  if (t == rtc_alarm && t.state == rtc_alarm.state) return;
+  rtc_alarm = t;
+  if (t.state == INACTIVE) {
+    rtc.setAlarmMode(0);
+    return;
+  }
+  rtc.setAlarm(0, t.minutes, t.hours24, 0, 0);
+  // Once a day, when the hours, minutes and seconds match. It goes off on
+  // days without an alarm at that time too, which does no harm.
+  rtc.setAlarmMode(4);
+}
+
+// In the waiting state, the stop button skips the next alarm when it's
+// released, unless it was held long enough to disable all alarms instead.
+bool stop_tap_pending = false;
+
+void HandleButton(const debouncer::Event& e, const ClockSnapshot& now) {
+  if (e.button == kStopButton) {
+    if (e.type == debouncer::kPress) {
+      stop_tap_pending = false;
+      if (state == WAITING) {
+        stop_tap_pending = true;
+      } else if (state == SNOOZING) {
+        TransitionStateTo(WAITING, now);
+      } else if (state == SOUNDING) {
+        sound.stop();
+        TransitionStateTo(WAITING, now);
+      }
+    } else if (stop_tap_pending) {
+      stop_tap_pending = false;
+      if (e.type == debouncer::kLongPress) {
+        ToggleAlarmsOff(now);
+      } else {
+        ToggleSkipped(now);
+      }
     }
-  } else if (state == SOUNDING_SHABBAT) {
-    if (!mp3.isPlaying()) {
-      TransitionStateTo(WAITING);
+  } else if (e.button == kSnoozeButton && e.type == debouncer::kPress) {
+    // A nap, rather than a snoozed alarm.
+    if (state == WAITING) alarm_sound = kAlarmSound;
+    if (state == WAITING || state == SOUNDING) {
+      TransitionStateTo(SNOOZING, now);
+    } else if (state == SNOOZING) {
+      ExtendSnooze(now);
     }
-    // Don't respond to buttons in this mode.
   }
 }
 
-// Runs Handle in a loop for ms milliseconds.
-// This is used in the menu system instead of delay()
-// for long pauses where the menu system expects no user input
-// (e.g. when displaying an error message.)
-// to ensure that state machine events are handled during that time.
-void HandleForMillis(unsigned long ms) {
-  unsigned long start = millis();
-  do {
-    Handle();
-    delay(50);
-  } while (millis() - start <= ms);
+// Uses the playback status cached by sound.
+void Handle(const ClockSnapshot& now) {
+  const uint16_t minute = now.MinuteOfWeek();
+  if (last_minute == kNoMinute) last_minute = minute;
+  const uint16_t elapsed =
+      (minute - last_minute + kMinutesPerWeek) % kMinutesPerWeek;
+  if (elapsed > 0) {
+    MinutesPassed(now, last_minute, elapsed);
+    last_minute = minute;
+  }
+  if ((state == SOUNDING || state == SOUNDING_SHABBAT) && !sound.playing()) {
+    TransitionStateTo(WAITING, now);
+  }
+  debouncer::Event e;
+  while (buttons.take(&e)) {
+    // Don't respond to buttons while the shabbat alarm is sounding. Presses
+    // made then are dropped, not saved up for afterwards.
+    if (state == SOUNDING_SHABBAT) {
+      stop_tap_pending = false;
+      continue;
+    }
+    HandleButton(e, now);
+  }
+  SetRtcAlarm();
 }
 
 } // namespace statemachine
 
 namespace display {
 
-void PrintTimeTall() {
-  Time t = Time::FromClock();
+void PrintTimeTall(const ClockSnapshot& now) {
+  Time t = now.time();
   // sprintf is used here (instead of opening font as a FILE* and using fprintf)
-  // in order to speed the display by minimizing the number of calls to lcd.setCursor,
-  // which is slow. It's not a super big problem, but we do want to call
-  // statemachine::Handle at least once a second, and the slow updates were making
-  // me nervous.
+  // so that the Writer gets the whole string in one write() call, rather than
+  // one call per character.
   char buf[10];
   sprintf_P(buf, PSTR("%2d:%02d "), t.hours12(), t.minutes);
-  double_high_digits::Writer<SerLCD> font(lcd);
-  font.setCursor(0, 0);
+  double_high_digits::Cells<6> digits;
+  double_high_digits::Writer<decltype(digits), 6> font(digits);
   font.print(buf);
-  lcd.setCursor(6, 0);
-  fprintf_P(lcd_file, PSTR("%-7s"), kDayNames[rtc.getWeekday()]);
-  lcd.setCursor(6, 1);
+  digits.flush(screen, 0, 0);
+  screen.setCursor(6, 0);
+  fprintf_P(lcd_file, PSTR("%-7s"), kDayNames[now.weekday]);
+  screen.setCursor(6, 1);
   fprintf_P(lcd_file, PSTR("%-6s"), t.amPMString());
 }
 
 void PrintNextAlarm() {
-  int day = NextAlarmDay();
-  if (day == -1) {
+  if (next_alarm.day == -1) {
     ClearStatusArea();
     return;
   }
-  lcd.setCursor(13, 0);
-  lcd.print(kDayNames[day]);
-  lcd.setCursor(12, 1);
-  const Time& t = persistent_settings.alarms[day];
-  switch (t.state) {
+  screen.setCursor(13, 0);
+  screen.print(kDayNames[next_alarm.day]);
+  screen.setCursor(12, 1);
+  switch (next_alarm.time.state) {
     case INACTIVE:
-      lcd.print(F(" Off"));
+      screen.print(F(" Off"));
       break;
     case ACTIVE:
-      lcd.print(F("  On"));
+      screen.print(F("  On"));
       break;
     case SKIP_NEXT:
-      lcd.print(F("Skip"));
+      screen.print(F("Skip"));
       break;
     case SHABBAT:
-      lcd.print(F("Shbt"));
+      screen.print(F("Shbt"));
       break;
     case kMaxTimeState:
-      lcd.print(F("    "));
+      screen.print(F("    "));
       break;
   }
 }
 
-void PrintShabbatStatus() {
-  lcd.setCursor(13, 0);
-  lcd.print(kDayNames[rtc.getWeekday()]);
-  lcd.setCursor(12, 1);
-  lcd.print(F("Shbt"));
+void PrintShabbatStatus(const ClockSnapshot& now) {
+  screen.setCursor(13, 0);
+  screen.print(kDayNames[now.weekday]);
+  screen.setCursor(12, 1);
+  screen.print(F("Shbt"));
 }
 
 void ClearStatusArea() {
-  lcd.setCursor(13, 0);
-  lcd.print(F("   "));
-  lcd.setCursor(12, 0);
-  lcd.print(F("    "));
+  screen.setCursor(13, 0);
+  screen.print(F("   "));
+  screen.setCursor(12, 1);
+  screen.print(F("    "));
 }
 
-void PrintMainDisplay() {
-  if (stop_button.isPressed() || snooze_button.isPressed()) {
-    lcd.setFastBacklight(255, 32, 0);
+void PrintMainDisplay(const ClockSnapshot& now) {
+  if (buttons.any_pressed()) {
+    screen.setFastBacklight(255, 32, 0);
   } else {
-    lcd.setFastBacklight(255, 0, 0);
+    screen.setFastBacklight(255, 0, 0);
   }
-  PrintTimeTall();
+  PrintTimeTall(now);
   if (state == SNOOZING) {
-    Time now = Time::FromClock();
-    lcd.setCursor(13, 0);
-    lcd.print(F("Snz"));
-    lcd.setCursor(12, 1);
-    fprintf_P(lcd_file, PSTR("%3dm"), snooze - now);
+    screen.setCursor(13, 0);
+    screen.print(F("Snz"));
+    screen.setCursor(12, 1);
+    fprintf_P(lcd_file, PSTR("%3dm"), snooze - now.time());
   }
   if (state == SOUNDING_SHABBAT) {
-    PrintShabbatStatus();
+    PrintShabbatStatus(now);
   }
   if (state == SOUNDING) {
     ClearStatusArea();
@@ -917,34 +1621,1158 @@ void PrintMainDisplay() {
 
 } // namespace display
 
+namespace storage {
+
+// Bumped whenever the format of the records changes. Load() converts
+// anything older to the current format.
+//
+// Version 0 was PersistentSettings written as-is at address 0.
+constexpr uint8_t kLayoutVersion = 1;
+
+// A year's bits for one calendar flag, 46 bytes, and a byte saying which
+// year.
+constexpr uint8_t kCalendarBitsetBytes = 47;
+// The calendar's bitsets, one for each flag and year parity, at the end of
+// the EEPROM. They're outside the journal, which would need a record for
+// every 4 bytes of them, and a byte of RAM for every record.
+constexpr uint16_t kCalendarBytes =
+    calendar::kNumFlags * 2 * kCalendarBitsetBytes;
+
+enum Record : uint8_t {
+  // {flags, snooze_length, 0, kLayoutVersion}.
+  kHeader,
+  // One per slot of persistent_settings.alarms, packed by PackAlarm.
+  kFirstAlarm,
+  kNumRecords = kFirstAlarm + kMaxAlarms,
+};
+
+// Bits of the header's flags byte.
+constexpr uint8_t kAlarmsOff = bit(0);
+
+typedef eeprom_journal::Journal<EEPROMClass, kNumRecords> Journal;
+Journal journal(EEPROM, 0, EEPROM.length() - kCalendarBytes);
+
+uint16_t CalendarBegin() {
+  return EEPROM.length() - kCalendarBytes;
+}
+
+static_assert(kMaxTimeState <= 4, "PackAlarm stores the state in 2 bits");
+
+// 7 bits of days, 11 bits of minute of the day, 2 bits of state, and 8 bits
+// of sound, from the lowest bit up.
+uint32_t PackAlarm(const Alarm& a) {
+  return a.days | (static_cast<uint32_t>(a.time.minuteOfDay()) << 7) |
+         (static_cast<uint32_t>(a.time.state) << 18) |
+         (static_cast<uint32_t>(a.sound) << 20);
+}
+
+// Settings that are out of range (from a corrupted or blank EEPROM) are left
+// as they were.
+void SetAlarm(uint8_t slot, uint8_t days, uint8_t hours24, uint8_t minutes,
+              uint8_t state, uint8_t sound) {
+  if (days >= bit(7) || hours24 >= 24 || minutes >= 60 ||
+      state >= kMaxTimeState) {
+    return;
+  }
+  Alarm& alarm = persistent_settings.alarms[slot];
+  alarm.days = days;
+  alarm.time.hours24 = hours24;
+  alarm.time.minutes = minutes;
+  alarm.time.state = static_cast<TimeState>(state);
+  alarm.sound = sound;
+}
+
+// Version 0 had one alarm per weekday. Each one becomes an alarm for just
+// that day, in the slot numbered after it, inactive ones included, so that
+// the menu lists them as it always did.
+void SetDayAlarm(uint8_t day, uint8_t hours24, uint8_t minutes,
+                 uint8_t state) {
+  SetAlarm(day, bit(day), hours24, minutes, state, 0);
+}
+
+void SetSnoozeLength(int snooze_length) {
+  if (snooze_length < 1 || snooze_length > 20) return;
+  persistent_settings.snooze_length = snooze_length;
+}
+
+void UnpackAlarm(uint8_t slot, uint32_t packed) {
+  const uint16_t minute_of_day = (packed >> 7) & 0x7FF;
+  if (minute_of_day >= kMinutesPerDay) return;
+  SetAlarm(slot, packed & 0x7F, minute_of_day / 60, minute_of_day % 60,
+           (packed >> 18) & 0x3, packed >> 20);
+}
+
+void SetDefaults() {
+  for (uint8_t slot = 0; slot < kMaxAlarms; slot++) {
+    persistent_settings.alarms[slot] = Alarm();
+  }
+  for (uint8_t day = 0; day < 7; day++) {
+    SetDayAlarm(day, 7, 0, INACTIVE);
+  }
+  persistent_settings.alarms_off = false;
+  persistent_settings.snooze_length = 9;
+}
+
+void LoadVersion0() {
+  // PersistentSettings as avr-gcc laid it out, before TimeState and
+  // snooze_length were narrowed to one byte. alarms_off was a bool, read as
+  // a byte here, since a blank EEPROM's 0xFF isn't a valid bool.
+  struct {
+    struct {
+      uint8_t hours24;
+      uint8_t minutes;
+      int16_t state;
+    } alarms[7];
+    uint8_t alarms_off;
+    int16_t snooze_length;
+  } v0;
+  EEPROM.get(0, v0);
+  for (uint8_t day = 0; day < 7; day++) {
+    SetDayAlarm(day, v0.alarms[day].hours24, v0.alarms[day].minutes,
+                v0.alarms[day].state);
+  }
+  persistent_settings.alarms_off = v0.alarms_off == 1;
+  SetSnoozeLength(v0.snooze_length);
+}
+
+void LoadCurrent() {
+  Journal::Payload p;
+  if (journal.read(kHeader, p)) {
+    persistent_settings.alarms_off = p[0] & kAlarmsOff;
+    SetSnoozeLength(p[1]);
+  }
+  for (uint8_t slot = 0; slot < kMaxAlarms; slot++) {
+    if (journal.read(kFirstAlarm + slot, p)) {
+      UnpackAlarm(slot, p[0] | (static_cast<uint32_t>(p[1]) << 8) |
+                        (static_cast<uint32_t>(p[2]) << 16) |
+                        (static_cast<uint32_t>(p[3]) << 24));
+    }
+  }
+}
+
+uint8_t StoredVersion() {
+  if (journal.begin() == 0) return 0;
+  Journal::Payload p;
+  // If the header failed its CRC, the alarms are still worth loading.
+  return journal.read(kHeader, p) ? p[3] : kLayoutVersion;
+}
+
+// Starts from defaults, so that any record that is missing or failed its
+// CRC is filled in.
+void Load() {
+  SetDefaults();
+  const uint8_t version = StoredVersion();
+  if (version == kLayoutVersion) {
+    LoadCurrent();
+  } else {
+    if (version == 0) LoadVersion0();
+    // A version from the future gets the defaults.
+    journal.format();
+    Save();
+    calendar::Clear();
+  }
+  alarm_index.Sort();
+}
+
+void Save() {
+  profiler::Scope scope(profiler::kSave);
+  const Journal::Payload header = {
+    static_cast<uint8_t>(persistent_settings.alarms_off ? kAlarmsOff : 0),
+    persistent_settings.snooze_length,
+    0,
+    kLayoutVersion
+  };
+  journal.write(kHeader, header);
+  // Unused slots too, so that a deleted alarm doesn't come back.
+  for (uint8_t slot = 0; slot < kMaxAlarms; slot++) {
+    const uint32_t packed = PackAlarm(persistent_settings.alarms[slot]);
+    const Journal::Payload p = {
+      static_cast<uint8_t>(packed),
+      static_cast<uint8_t>(packed >> 8),
+      static_cast<uint8_t>(packed >> 16),
+      static_cast<uint8_t>(packed >> 24),
+    };
+    journal.write(kFirstAlarm + slot, p);
+  }
+}
+
+} // namespace storage
+
+namespace calendar {
+
+// Each flag has two bitsets, one for even years and one for odd ones, so
+// that this year's and next year's are both kept. A bitset is
+// storage::kCalendarBitsetBytes bytes of the EEPROM, outside the journal:
+// byte 0 is the year it's for, and bit d of the bytes after that is day of
+// the year d. Looking up a day is two EEPROM reads, whatever the rest of the
+// calendar holds. Changing a day writes its byte in place, so a byte wears
+// out after 100,000 changes to its 8 days, and claiming a bitset for a new
+// year writes each byte once a year.
+constexpr uint8_t kNoYear = 0xFF;
+constexpr uint16_t kNoAddress = 0xFFFF;
+
+uint16_t BitsetAddress(Flag flag, uint8_t year) {
+  return storage::CalendarBegin() +
+         (flag * 2 + year % 2) * storage::kCalendarBitsetBytes;
+}
+
+bool IsSet(Flag flag, const Date& day) {
+  if (day.day_of_year >= DaysInYear(day.year)) return false;
+  const uint16_t first = BitsetAddress(flag, day.year);
+  if (EEPROM.read(first) != day.year) return false;
+  return EEPROM.read(first + 1 + day.day_of_year / 8) &
+         bit(day.day_of_year % 8);
+}
+
+// The clock's year and the next: as far ahead as anyone plans a vacation,
+// and no further than the two bitsets reach.
+bool InRange(const Date& day, const Date& today) {
+  return day.year == today.year || day.year == today.year + 1;
+}
+
+// Takes over a bitset that holds another year, by emptying it. The year
+// goes in last, so that a bitset cut short by a power failure isn't taken
+// for that year's.
+void Claim(Flag flag, uint8_t year) {
+  const uint16_t first = BitsetAddress(flag, year);
+  if (EEPROM.read(first) == year) return;
+  EEPROM.update(first, kNoYear);
+  for (uint8_t i = 1; i < storage::kCalendarBitsetBytes; i++) {
+    EEPROM.update(first + i, 0);
+  }
+  EEPROM.update(first, year);
+}
+
+// Writes each byte once, however many of its days change.
+void SetRange(Flag flag, Date from, const Date& to, bool on) {
+  uint16_t address = kNoAddress;
+  uint8_t bits = 0;
+  for (; !(to < from); from += 1) {
+    const uint16_t a =
+        BitsetAddress(flag, from.year) + 1 + from.day_of_year / 8;
+    if (a != address) {
+      if (address != kNoAddress) EEPROM.update(address, bits);
+      Claim(flag, from.year);
+      address = a;
+      bits = EEPROM.read(address);
+    }
+    if (on) {
+      bits |= bit(from.day_of_year % 8);
+    } else {
+      bits &= ~bit(from.day_of_year % 8);
+    }
+  }
+  if (address != kNoAddress) EEPROM.update(address, bits);
+}
+
+// Finds the first run of days with the flag set, starting at *from or
+// later, within InRange() of today.
+bool NextRange(Flag flag, const Date& today, Date* from, Date* to) {
+  while (InRange(*from, today) && !IsSet(flag, *from)) *from += 1;
+  if (!InRange(*from, today)) return false;
+  *to = *from;
+  Date next = *to;
+  while (InRange(next += 1, today) && IsSet(flag, next)) *to = next;
+  return true;
+}
+
+// Only the year needs clearing: the rest of a bitset is emptied when it's
+// claimed again.
+void Clear() {
+  for (uint8_t flag = 0; flag < kNumFlags; flag++) {
+    for (uint8_t parity = 0; parity < 2; parity++) {
+      EEPROM.update(BitsetAddress(static_cast<Flag>(flag), parity), kNoYear);
+    }
+  }
+}
+
+} // namespace calendar
+
+namespace bus {
+
+constexpr uint32_t kStandardClock = 100000;
+constexpr uint32_t kFastClock = 400000;
+// How long the Wire library waits on a transaction before giving up and
+// resetting the TWI hardware. The longest transaction anyone makes is a
+// 32 byte read, about 3 ms at 100 kHz.
+constexpr uint32_t kTimeoutMicros = 25000;
+// How many times each device has to answer at 400 kHz for the bus to run at
+// that speed.
+constexpr uint8_t kFastProbes = 4;
+
+struct Health {
+  // Transactions with the device that the Wire library gave up on.
+  uint16_t timeouts;
+  // Pings that it didn't answer.
+  uint16_t misses;
+  // Times it was set up again after coming back.
+  uint16_t resets;
+  // Whether it has stopped answering. Poll() sets it up again once it does.
+  bool down;
+};
+
+Health health[i2c_stats::kOther];
+uint32_t clock_hz = kStandardClock;
+
+void StartWire() {
+  Wire.begin();
+  Wire.setClock(clock_hz);
+  Wire.setWireTimeout(kTimeoutMicros, true);
+}
+
+// The bus clear procedure from the I2C specification. A device that was
+// cut off in the middle of sending a byte (by a reset of the RedBoard, or a
+// power sag) holds SDA low until it has been clocked through the rest of it,
+// which takes at most nine pulses on SCL. A STOP then leaves the bus idle.
+void Recover() {
+  Wire.end();
+  pinMode(SDA, INPUT_PULLUP);
+  pinMode(SCL, INPUT_PULLUP);
+  for (uint8_t i = 0; i < 9 && digitalRead(SDA) == LOW; i++) {
+    digitalWrite(SCL, LOW);
+    pinMode(SCL, OUTPUT);
+    delayMicroseconds(5);
+    pinMode(SCL, INPUT_PULLUP);
+    delayMicroseconds(5);
+  }
+  digitalWrite(SDA, LOW);
+  pinMode(SDA, OUTPUT);
+  delayMicroseconds(5);
+  pinMode(SDA, INPUT_PULLUP);
+  delayMicroseconds(5);
+  StartWire();
+}
+
+// Whether a device answers at address. A transaction that timed out means
+// the bus is stuck, so it gets cleared right away.
+bool Ping(uint8_t address) {
+  Wire.beginTransmission(address);
+  const bool answered = Wire.endTransmission() == 0;
+  if (Wire.getWireTimeoutFlag()) {
+    Wire.clearWireTimeoutFlag();
+    Recover();
+  }
+  return answered;
+}
+
+// Clears the bus in case it was left stuck, and picks 400 kHz if every
+// device that answers at 100 kHz answers at 400 kHz too. The SerLCD and the
+// RTC handle I2C in hardware, but the keypad and the MP3 trigger are run by
+// ATtinys that may not keep up, especially at the end of long cables.
+void Begin() {
+  clock_hz = kStandardClock;
+  Recover();
+  bool present[i2c_stats::kOther];
+  for (uint8_t d = 0; d < i2c_stats::kOther; d++) {
+    present[d] = Ping(i2c_stats::AddressOf(static_cast<i2c_stats::Device>(d)));
+  }
+  clock_hz = kFastClock;
+  Wire.setClock(clock_hz);
+  for (uint8_t d = 0; d < i2c_stats::kOther; d++) {
+    if (!present[d]) continue;
+    for (uint8_t i = 0; i < kFastProbes; i++) {
+      if (Ping(i2c_stats::AddressOf(static_cast<i2c_stats::Device>(d)))) {
+        continue;
+      }
+      clock_hz = kStandardClock;
+      Wire.setClock(clock_hz);
+      return;
+    }
+  }
+}
+
+// Sets up a device, at startup, or after it stopped answering and came
+// back, probably without whatever it had been told before.
+void BeginDevice(i2c_stats::Device device) {
+  switch (device) {
+    case i2c_stats::kLcd:
+      lcd.begin(Wire);
+      double_high_digits::Install(lcd);
+      screen.invalidate();
+      task_scheduler.Wake(tasks::kDisplay);
+      break;
+    case i2c_stats::kKeypad:
+      keypad.begin();
+      break;
+    case i2c_stats::kMp3:
+      mp3.begin();
+      // It may have come back with a different card.
+      catalog.scan();
+      sound.restore();
+      break;
+    case i2c_stats::kRtc:
+      rtc.begin();
+      rtc.set24Hour();
+      rtc.enableInterrupt(INTERRUPT_AIE);
+      // Make the state machine set the alarm again.
+      statemachine::rtc_alarm = Time();
+      task_scheduler.Wake(tasks::kClock);
+      task_scheduler.Wake(tasks::kStateMachine);
+      break;
+    default:
+      break;
+  }
+}
+
+// Called after each task that talks to device. The Wire library gives up on
+// a transaction after kTimeoutMicros, but the device libraries carry on
+// regardless, so this is where a stuck bus gets noticed. Returns false if
+// something timed out, in which case whatever the task read is garbage.
+bool Check(i2c_stats::Device device) {
+  if (!Wire.getWireTimeoutFlag()) return true;
+  Wire.clearWireTimeoutFlag();
+  health[device].timeouts++;
+  Recover();
+  // It may have lost what it was told in the middle of that, or been reset
+  // by whatever stuck the bus. Poll() sets it up again once it answers.
+  health[device].down = true;
+  task_scheduler.Wake(tasks::kBus);
+  return false;
+}
+
+bool IsDown(i2c_stats::Device device) {
+  return health[device].down;
+}
+
+// Pings every device, and sets up again any that has come back.
+void Poll() {
+  for (uint8_t d = 0; d < i2c_stats::kOther; d++) {
+    const i2c_stats::Device device = static_cast<i2c_stats::Device>(d);
+    Health& h = health[d];
+    if (!Ping(i2c_stats::AddressOf(device))) {
+      h.misses++;
+      h.down = true;
+    } else if (h.down) {
+      h.down = false;
+      h.resets++;
+      BeginDevice(device);
+    }
+  }
+}
+
+// Prints a table like
+//   bus: 400 kHz
+//   dev    addr timeouts misses resets
+//   MP3    0x37        0      0      0
+//   ...
+void Report() {
+  char buf[48];
+  snprintf_P(buf, sizeof(buf), PSTR("bus: %lu kHz"),
+             static_cast<unsigned long>(clock_hz / 1000));
+  Serial.println(buf);
+  Serial.println(F("dev    addr timeouts misses resets"));
+  for (uint8_t d = 0; d < i2c_stats::kOther; d++) {
+    const i2c_stats::Device device = static_cast<i2c_stats::Device>(d);
+    const Health& h = health[d];
+    char name[7];
+    i2c_stats::GetName(device, name);
+    snprintf_P(buf, sizeof(buf), PSTR("%-6s 0x%02X %8u %6u %6u%s"),
+               name, i2c_stats::AddressOf(device), h.timeouts, h.misses,
+               h.resets, h.down ? " down" : "");
+    Serial.println(buf);
+  }
+}
+
+} // namespace bus
+
+namespace console {
+
+constexpr uint8_t kMaxLineLength = 40;
+
+char line[kMaxLineLength + 1];
+uint8_t line_length = 0;
+
+// Adds whatever has arrived to line, up to the end of a line. Returns true
+// once line holds a complete one. Overlong lines are truncated.
+bool ReadLine() {
+  while (Serial.available()) {
+    const char c = Serial.read();
+    if (c == '\r' || c == '\n') {
+      if (line_length == 0) continue;
+      line[line_length] = '\0';
+      line_length = 0;
+      return true;
+    } else if (line_length < kMaxLineLength) {
+      line[line_length++] = c;
+    }
+  }
+  return false;
+}
+
+// Reads whatever has arrived since the last call, and executes each complete
+// line.
+void Poll() {
+  profiler::Scope scope(profiler::kConsole);
+  while (ReadLine()) Execute(line);
+}
+
+// Settings in bulk, for setting up a clock from a computer instead of the
+// keypad. A batch is a "begin" line, any number of these lines:
+//
+//   alarm <slot 0-13> <days> <HH:MM> <inactive|active|skip|shabbat> [sound]
+//   alarm <day 0-6> <HH:MM> <inactive|active|skip|shabbat>
+//   alarms <on|off|clear>
+//   <off|holiday|normal> <YYYY-MM-DD> [YYYY-MM-DD]
+//   calendar clear
+//   snooze <minutes, 1-20>
+//   volume <0-31>
+//   eq <0-5>
+//   clock <YYYY-MM-DD HH:MM:SS>
+//
+// and an "end <crc>" line, where crc is two hex digits of the CRC-8 that
+// eeprom_journal uses, over the lines in between, each followed by '\n'.
+//
+// days is like "-MTWTF-", as FormatDays() writes it; "-------" empties the
+// slot. sound is the MP3 file the alarm plays, if not the default for its
+// state, and has to be on the card, unless the clock doesn't see one. The
+// second form of alarm line is a shorthand for an alarm on just that day, in
+// the slot numbered after it. "alarms clear" empties every slot.
+// off and holiday mark the days from the first date through the second (or
+// just the one) in the calendar, this year or next, and normal unmarks them;
+// "calendar clear" unmarks every day.
+// Nothing changes until the end line arrives, and then only if every line
+// made sense and the CRC matches. Then all of it takes effect at once, with
+// one storage::Save(), and the reply is "ok"; otherwise it's "error". The
+// clock does nothing else while a batch arrives, so it gives up on one with
+// "error" if kBatchTimeoutMillis pass between its lines, if the whole batch
+// takes more than kMaxBatchMillis, or if it has more than kMaxBatchLines
+// lines.
+//
+// "settings" prints the current settings as a batch, which can be sent back
+// as it is. tools/provision.py does both.
+const char kStateNames[kMaxTimeState][9] PROGMEM = {
+  "inactive",
+  "active",
+  "skip",
+  "shabbat",
+};
+
+// A calendar line's flag, or kNumFlags for normal.
+const char kCalendarNames[calendar::kNumFlags + 1][8] PROGMEM = {
+  "off",
+  "holiday",
+  "normal",
+};
+
+constexpr uint8_t kCrcInit = 0xFF;
+
+// How many calendar lines a batch holds: they only take effect at its end,
+// so each one costs stack until then.
+constexpr uint8_t kMaxBatchRanges = 8;
+// What "settings" prints, at most: every alarm slot, every range, and seven
+// lines for the rest. A batch doesn't need any more.
+constexpr uint8_t kMaxBatchLines = kMaxAlarms + kMaxBatchRanges + 7;
+constexpr unsigned long kBatchTimeoutMillis = 2000;
+// kMaxBatchLines of kMaxLineLength take about 1.2 s at 9600 baud. This is
+// the longest an alarm can go unhandled while a batch arrives.
+constexpr unsigned long kMaxBatchMillis = 5000;
+
+struct CalendarRange {
+  uint8_t flag;
+  Date from;
+  Date to;
+};
+
+// What a batch sets, until its end line. It lives on ReadBatch()'s stack
+// rather than in static RAM, since it's only needed while one arrives.
+struct Batch {
+  // Whether every line so far made sense.
+  bool valid;
+  uint8_t crc;
+  PersistentSettings settings;
+  uint8_t volume;
+  uint8_t eq;
+  bool set_clock;
+  // Years since 2000.
+  uint8_t year;
+  uint8_t month;
+  uint8_t date;
+  uint8_t hours24;
+  uint8_t minutes;
+  uint8_t seconds;
+  // Done before the ranges.
+  bool clear_calendar;
+  CalendarRange ranges[kMaxBatchRanges];
+  uint8_t num_ranges;
+};
+
+uint8_t UpdateCrc(uint8_t crc, const char* line) {
+  for (; *line != '\0'; line++) crc = _crc8_ccitt_update(crc, *line);
+  return _crc8_ccitt_update(crc, '\n');
+}
+
+void PrintBatchLine(const char* line, uint8_t* crc) {
+  Serial.println(line);
+  *crc = UpdateCrc(*crc, line);
+}
+
+// Writes "<name> YYYY-MM-DD", and " YYYY-MM-DD" after that for a range of
+// more than one day.
+void FormatRange(const char* name, const Date& from, const Date& to,
+                 char (&buf)[kMaxLineLength + 1]) {
+  uint8_t month, date;
+  from.toMonthDate(&month, &date);
+  int n = snprintf_P(buf, sizeof(buf), PSTR("%s 20%02u-%02u-%02u"), name,
+                     from.year, month, date);
+  if (from < to) {
+    to.toMonthDate(&month, &date);
+    snprintf_P(buf + n, sizeof(buf) - n, PSTR(" 20%02u-%02u-%02u"), to.year,
+               month, date);
+  }
+}
+
+void PrintSettings() {
+  char buf[kMaxLineLength + 1];
+  char name[9];
+  char days[8];
+  uint8_t crc = kCrcInit;
+  Serial.println(F("begin"));
+  strcpy_P(buf, PSTR("alarms clear"));
+  PrintBatchLine(buf, &crc);
+  for (uint8_t slot = 0; slot < kMaxAlarms; slot++) {
+    const Alarm& alarm = persistent_settings.alarms[slot];
+    if (alarm.days == 0) continue;
+    const Time& t = alarm.time;
+    strcpy_P(name, kStateNames[t.state]);
+    FormatDays(alarm.days, days);
+    const int n = snprintf_P(buf, sizeof(buf), PSTR("alarm %u %s %02u:%02u %s"),
+                             slot, days, t.hours24, t.minutes, name);
+    if (alarm.sound != 0) {
+      snprintf_P(buf + n, sizeof(buf) - n, PSTR(" %u"), alarm.sound);
+    }
+    PrintBatchLine(buf, &crc);
+  }
+  snprintf_P(buf, sizeof(buf), PSTR("alarms %s"),
+             persistent_settings.alarms_off ? "off" : "on");
+  PrintBatchLine(buf, &crc);
+  strcpy_P(buf, PSTR("calendar clear"));
+  PrintBatchLine(buf, &crc);
+  const Date today = clock_now.day();
+  for (uint8_t flag = 0; flag < calendar::kNumFlags; flag++) {
+    strcpy_P(name, kCalendarNames[flag]);
+    Date from = {today.year, 0};
+    Date to;
+    while (calendar::NextRange(static_cast<calendar::Flag>(flag), today,
+                               &from, &to)) {
+      FormatRange(name, from, to, buf);
+      PrintBatchLine(buf, &crc);
+      from = to;
+      from += 1;
+    }
+  }
+  snprintf_P(buf, sizeof(buf), PSTR("snooze %u"),
+             persistent_settings.snooze_length);
+  PrintBatchLine(buf, &crc);
+  snprintf_P(buf, sizeof(buf), PSTR("volume %u"), sound.volume());
+  PrintBatchLine(buf, &crc);
+  snprintf_P(buf, sizeof(buf), PSTR("eq %u"), sound.eq());
+  PrintBatchLine(buf, &crc);
+  rtc.updateTime();
+  snprintf_P(buf, sizeof(buf), PSTR("clock 20%02u-%02u-%02u %02u:%02u:%02u"),
+             rtc.getYear(), rtc.getMonth(), rtc.getDate(),
+             rtc.getHours(), rtc.getMinutes(), rtc.getSeconds());
+  PrintBatchLine(buf, &crc);
+  snprintf_P(buf, sizeof(buf), PSTR("end %02x"), crc);
+  Serial.println(buf);
+}
+
+void BeginBatch(Batch& batch) {
+  batch.valid = true;
+  batch.crc = kCrcInit;
+  batch.settings = persistent_settings;
+  batch.volume = sound.volume();
+  batch.eq = sound.eq();
+  batch.set_clock = false;
+  batch.clear_calendar = false;
+  batch.num_ranges = 0;
+}
+
+// Returns kMaxTimeState if name isn't one.
+uint8_t ParseState(const char* name) {
+  uint8_t state = 0;
+  while (state < kMaxTimeState && strcmp_P(name, kStateNames[state]) != 0) {
+    state++;
+  }
+  return state;
+}
+
+// Returns false unless days is like "-MTWTF-".
+bool ParseDays(const char* days, uint8_t* mask) {
+  if (strlen(days) != 7) return false;
+  *mask = 0;
+  for (uint8_t d = 0; d < 7; d++) {
+    if (days[d] == pgm_read_byte(&kDayLetters[d])) {
+      *mask |= bit(d);
+    } else if (days[d] != '-') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns false unless it's a real date, in the calendar's range.
+bool ParseCalendarDate(unsigned year, unsigned month, unsigned date,
+                       Date* day) {
+  if (year < 2000 || year > 2099 || month < 1 || month > 12 || date < 1 ||
+      date > DaysInMonth(year - 2000, month)) {
+    return false;
+  }
+  *day = Date::From(year - 2000, month, date);
+  return calendar::InRange(*day, clock_now.day());
+}
+
+bool AddBatchRange(Batch& batch, const char* name, const Date& from,
+                   const Date& to) {
+  uint8_t flag = 0;
+  while (flag <= calendar::kNumFlags &&
+         strcmp_P(name, kCalendarNames[flag]) != 0) {
+    flag++;
+  }
+  if (flag > calendar::kNumFlags || to < from ||
+      batch.num_ranges == kMaxBatchRanges) {
+    return false;
+  }
+  batch.ranges[batch.num_ranges++] = {flag, from, to};
+  return true;
+}
+
+bool SetBatchAlarm(Batch& batch, unsigned slot, uint8_t days,
+                   unsigned hours24, unsigned minutes, const char* state_name,
+                   unsigned sound) {
+  const uint8_t state = ParseState(state_name);
+  if (slot >= kMaxAlarms || hours24 >= 24 || minutes >= 60 ||
+      state == kMaxTimeState || sound > 255 ||
+      (sound != 0 && catalog.count() != 0 && !catalog.has(sound))) {
+    return false;
+  }
+  Alarm& alarm = batch.settings.alarms[slot];
+  alarm = Alarm();
+  if (days == 0) return true;
+  alarm.days = days;
+  alarm.time.hours24 = hours24;
+  alarm.time.minutes = minutes;
+  alarm.time.state = static_cast<TimeState>(state);
+  alarm.sound = sound;
+  return true;
+}
+
+// Returns false if the line isn't a setting, or is out of range.
+bool ParseBatchLine(Batch& batch, const char* line) {
+  unsigned a, b, c, d, e, f;
+  char word[9];
+  char days[9];
+  uint8_t mask;
+  d = 0;
+  if (sscanf_P(line, PSTR("alarm %u %8s %u:%u %8s %u"),
+               &a, days, &b, &c, word, &d) >= 5) {
+    return ParseDays(days, &mask) &&
+           SetBatchAlarm(batch, a, mask, b, c, word, d);
+  }
+  if (sscanf_P(line, PSTR("alarm %u %u:%u %8s"), &a, &b, &c, word) == 4) {
+    return a < 7 && SetBatchAlarm(batch, a, bit(a), b, c, word, 0);
+  }
+  if (sscanf_P(line, PSTR("alarms %8s"), word) == 1) {
+    if (strcmp_P(word, PSTR("on")) == 0) {
+      batch.settings.alarms_off = false;
+    } else if (strcmp_P(word, PSTR("off")) == 0) {
+      batch.settings.alarms_off = true;
+    } else if (strcmp_P(word, PSTR("clear")) == 0) {
+      for (Alarm& alarm : batch.settings.alarms) alarm = Alarm();
+    } else {
+      return false;
+    }
+    return true;
+  }
+  if (sscanf_P(line, PSTR("snooze %u"), &a) == 1) {
+    if (a < 1 || a > 20) return false;
+    batch.settings.snooze_length = a;
+    return true;
+  }
+  if (sscanf_P(line, PSTR("volume %u"), &a) == 1) {
+    if (a > 31) return false;
+    batch.volume = a;
+    return true;
+  }
+  if (sscanf_P(line, PSTR("eq %u"), &a) == 1) {
+    if (a > 5) return false;
+    batch.eq = a;
+    return true;
+  }
+  if (sscanf_P(line, PSTR("clock %u-%u-%u %u:%u:%u"),
+               &a, &b, &c, &d, &e, &f) == 6) {
+    if (a < 2000 || a > 2099 || b < 1 || b > 12 || c < 1 ||
+        c > DaysInMonth(a - 2000, b) || d >= 24 || e >= 60 || f >= 60) {
+      return false;
+    }
+    batch.set_clock = true;
+    batch.year = a - 2000;
+    batch.month = b;
+    batch.date = c;
+    batch.hours24 = d;
+    batch.minutes = e;
+    batch.seconds = f;
+    return true;
+  }
+  if (strcmp_P(line, PSTR("calendar clear")) == 0) {
+    batch.clear_calendar = true;
+    batch.num_ranges = 0;
+    return true;
+  }
+  const int n = sscanf_P(line, PSTR("%8s %u-%u-%u %u-%u-%u"),
+                         word, &a, &b, &c, &d, &e, &f);
+  if (n == 4 || n == 7) {
+    Date from, to;
+    if (!ParseCalendarDate(a, b, c, &from)) return false;
+    if (n == 4) {
+      to = from;
+    } else if (!ParseCalendarDate(d, e, f, &to)) {
+      return false;
+    }
+    return AddBatchRange(batch, word, from, to);
+  }
+  return false;
+}
+
+void AddToBatch(Batch& batch, const char* line) {
+  batch.crc = UpdateCrc(batch.crc, line);
+  if (!ParseBatchLine(batch, line)) {
+    batch.valid = false;
+    Serial.print(F("error: "));
+    Serial.println(line);
+  }
+}
+
+// Returns false unless text is exactly two hex digits.
+bool ParseCrc(const char* text, uint8_t* crc) {
+  if (!isxdigit(text[0])) return false;
+  char* end;
+  *crc = strtoul(text, &end, 16);
+  return end == text + 2 && *end == '\0';
+}
+
+void EndBatch(Batch& batch, const char* crc_text) {
+  uint8_t crc;
+  if (!batch.valid || !ParseCrc(crc_text, &crc) || crc != batch.crc) {
+    Serial.println(F("error"));
+    return;
+  }
+  persistent_settings = batch.settings;
+  alarm_index.Sort();
+  if (batch.volume != sound.volume()) sound.setVolume(batch.volume);
+  if (batch.eq != sound.eq()) sound.setEq(batch.eq);
+  if (batch.set_clock) {
+    rtc.setTime(0, batch.seconds, batch.minutes, batch.hours24, batch.date,
+                batch.month, batch.year + 2000,
+                Weekday(batch.year, batch.month, batch.date));
+    tasks::ClockChanged();
+  }
+  if (batch.clear_calendar) calendar::Clear();
+  for (uint8_t i = 0; i < batch.num_ranges; i++) {
+    const CalendarRange& range = batch.ranges[i];
+    for (uint8_t flag = 0; flag < calendar::kNumFlags; flag++) {
+      // normal unmarks the days for both flags.
+      if (range.flag != flag && range.flag != calendar::kNumFlags) continue;
+      calendar::SetRange(static_cast<calendar::Flag>(flag), range.from,
+                         range.to, range.flag == flag);
+    }
+  }
+  storage::Save();
+  next_alarm.Recompute(clock_now);
+  task_scheduler.Wake(tasks::kStateMachine);
+  task_scheduler.Wake(tasks::kDisplay);
+  Serial.println(F("ok"));
+}
+
+// Reads the lines after a begin line, up to and including its end line.
+void ReadBatch() {
+  Batch batch;
+  BeginBatch(batch);
+  const unsigned long begin_millis = millis();
+  unsigned long last_line_millis = begin_millis;
+  uint8_t lines = 0;
+  while (millis() - last_line_millis < kBatchTimeoutMillis &&
+         millis() - begin_millis < kMaxBatchMillis) {
+    if (!ReadLine()) {
+      delay(1);
+      continue;
+    }
+    if (strncmp_P(line, PSTR("end "), 4) == 0) {
+      EndBatch(batch, line + 4);
+      return;
+    }
+    if (++lines > kMaxBatchLines) break;
+    AddToBatch(batch, line);
+    last_line_millis = millis();
+  }
+  Serial.println(F("error"));
+}
+
+void Execute(const char* line) {
+  if (strcmp_P(line, PSTR("i2c")) == 0) {
+#if defined(ARDUINO_ARCH_AVR) && !defined(ALARM_CLOCK_I2C_STATS)
+    Serial.println(F("Not counting: build with ALARM_CLOCK_I2C_STATS."));
+#endif
+    i2c_stats::Report(Serial);
+  } else if (strcmp_P(line, PSTR("i2c reset")) == 0) {
+    i2c_stats::Reset();
+  } else if (strcmp_P(line, PSTR("bus")) == 0) {
+    bus::Report();
+  } else if (strcmp_P(line, PSTR("prof")) == 0) {
+#ifdef ALARM_CLOCK_PROFILE
+    profiler::Report(Serial);
+#else
+    Serial.println(F("Not profiling: build with ALARM_CLOCK_PROFILE."));
+#endif
+  } else if (strcmp_P(line, PSTR("prof reset")) == 0) {
+#ifdef ALARM_CLOCK_PROFILE
+    profiler::Reset();
+#endif
+  } else if (strcmp_P(line, PSTR("ram")) == 0) {
+    ram_monitor::Report(Serial);
+  } else if (strcmp_P(line, PSTR("settings")) == 0) {
+    PrintSettings();
+  } else if (strcmp_P(line, PSTR("begin")) == 0) {
+    ReadBatch();
+  } else if (strcmp_P(line, PSTR("mp3")) == 0) {
+    // Only the status comes from the MP3 trigger, so this is the one place
+    // that waits for it on the bus. The songs are what catalog read.
+    // Status codes: 0 = OK, 1 = Fail, 2 = No such file, 5 = SD Error.
+    Serial.print(F("status "));
+    Serial.println(mp3.getStatus());
+    bus::Check(i2c_stats::kMp3);
+    Serial.print(F("songs "));
+    Serial.println(catalog.count());
+    for (uint8_t file = 1; file <= catalog.count() && file <= kNamedSounds;
+         file++) {
+      Serial.print(file);
+      Serial.print(' ');
+      Serial.println(catalog.name(file));
+    }
+  } else if (strcmp_P(line, PSTR("mp3 scan")) == 0) {
+    // For a card swapped while the trigger stayed connected. The scan stops
+    // whatever was playing, so it starts again.
+    catalog.scan();
+    bus::Check(i2c_stats::kMp3);
+    sound.restore();
+  } else {
+    Serial.print(F("Unknown command: "));
+    Serial.println(line);
+  }
+}
+
+} // namespace console
+
+namespace tasks {
+
+// How long after the start of a minute the clock is read.
+constexpr unsigned long kClockMarginMillis = 20;
+// How soon to try again after a reading failed.
+constexpr unsigned long kClockRetryMillis = 1000;
+// How often every device gets pinged, to notice one that stopped answering
+// (or came back).
+constexpr unsigned long kBusPeriodMillis = 10000;
+// sound sends at most one command per run, so this is also the spacing
+// between commands to the MP3 trigger.
+constexpr unsigned long kSoundPeriodMillis = 100;
+// How often sound asks the MP3 trigger whether it's still playing.
+constexpr unsigned long kSoundStatusPeriodMillis = 1000;
+// At 9600 baud, the serial port's 64 byte receive buffer fills up in 67 ms,
+// so a batch of settings sent in one go needs reading more often than that.
+// Polling also wakes the CPU from idle sleep every 10 ms, on top of Timer0's
+// ticks (where the buttons are sampled). Sleeping longer would take waking
+// the console from the USART's receive interrupt, and sampling the buttons
+// some other way.
+constexpr unsigned long kConsolePeriodMillis = 10;
+// How often free RAM is sampled, and how few never used bytes are worth a
+// warning.
+constexpr unsigned long kMemoryPeriodMillis = 10000;
+constexpr uint16_t kLowRamBytes = 64;
+
+// Keypresses read from the keypad that nobody has taken yet. The keypad's
+// own FIFO holds 15.
+ring_buffer::RingBuffer<char, 16> keys;
+// Whether ReadKeypad stopped because keys was full.
+bool keys_overflowed = false;
+// Whether the RTC has been set since ReadClock last read it.
+bool clock_changed = false;
+
+// Runs just after the start of every minute, and when the RTC's alarm goes
+// off. Nothing on the display shows seconds, so that's all the reading it
+// takes.
+void ReadClock() {
+  profiler::Scope scope(profiler::kClock);
+  if (digitalRead(kRtcInterruptPin) == LOW) rtc.clearInterrupts();
+  ClockSnapshot now;
+  const bool read = ClockSnapshot::Take(&now);
+  if (!bus::Check(i2c_stats::kRtc) || !read) {
+    task_scheduler.SetPeriod(kClock, kClockRetryMillis);
+    return;
+  }
+  if (clock_changed) {
+    clock_changed = false;
+    clock_now = now;
+    statemachine::ClockSet(clock_now);
+  }
+  const uint16_t last_minute = clock_now.MinuteOfWeek();
+  clock_now = now;
+  if (clock_now.MinuteOfWeek() != last_minute) {
+    next_alarm.Tick(clock_now);
+    task_scheduler.Wake(kStateMachine);
+    task_scheduler.Wake(kDisplay);
+  }
+  const unsigned long until_next_minute =
+      (59 - clock_now.seconds) * 1000UL + (100 - rtc.getHundredths()) * 10;
+  task_scheduler.SetPeriod(kClock, until_next_minute + kClockMarginMillis);
+}
+
+void PollSound() {
+  profiler::Scope scope(profiler::kSound);
+  // Whatever it says about playing means nothing until it's back.
+  if (bus::IsDown(i2c_stats::kMp3)) return;
+  sound.poll();
+  bus::Check(i2c_stats::kMp3);
+}
+
+void SoundFinished(uint8_t file) {
+  if (Wire.getWireTimeoutFlag()) {
+    // The trigger didn't answer, so it may well still be playing. For an
+    // alarm, starting the file over is better than going quiet.
+    sound.play(file);
+    return;
+  }
+  task_scheduler.Wake(kStateMachine);
+}
+
+// Only runs when the keypad's interrupt says there's something to read, and
+// then empties its FIFO, so that keys typed quickly all arrive in one go.
+void ReadKeypad() {
+  profiler::Scope scope(profiler::kKeypad);
+  while (!keys.full()) {
+    keypad.updateFIFO();
+    const char c = keypad.getButton();
+    if (!bus::Check(i2c_stats::kKeypad) || c == 0) return;
+    keys.push(c);
+  }
+  keys_overflowed = true;
+}
+
+// Returns 0 if there are no keys waiting.
+char TakeKey() {
+  char c = 0;
+  keys.pop(&c);
+  if (keys_overflowed) {
+    // The keypad's interrupt is still asserted, so it won't interrupt again.
+    keys_overflowed = false;
+    task_scheduler.Wake(kKeypad);
+  }
+  return c;
+}
+
+bool HasKey() {
+  return !keys.empty();
+}
+
+void RunStateMachine() {
+  profiler::Scope scope(profiler::kStateMachine);
+  statemachine::Handle(clock_now);
+  // Handle() sets the RTC's alarm.
+  bus::Check(i2c_stats::kRtc);
+  // The backlight is tinted while a button is held down.
+  static bool was_pressed = false;
+  const bool pressed = buttons.any_pressed();
+  if (pressed != was_pressed) {
+    was_pressed = pressed;
+    task_scheduler.Wake(kDisplay);
+  }
+}
+
+// Called after the RTC has been set. ReadClock reads it back, or keeps
+// trying until it can.
+void ClockChanged() {
+  clock_changed = true;
+  task_scheduler.Wake(kClock);
+}
+
+// Warns once on the serial port if the stack has ever come within
+// kLowRamBytes of the heap, which is worth knowing before it gets all the
+// way there.
+void SampleRam() {
+  ram_monitor::Sample();
+  static bool warned = false;
+  if (!ram_monitor::kMeasured || warned ||
+      ram_monitor::NeverUsed() >= kLowRamBytes) {
+    return;
+  }
+  warned = true;
+  Serial.print(F("Low on RAM. "));
+  ram_monitor::Report(Serial);
+}
+
+// Only runs when something on the main display may have changed.
+void RefreshDisplay() {
+  profiler::Scope scope(profiler::kDisplay);
+  display::PrintMainDisplay(clock_now);
+  screen.flush();
+  bus::Check(i2c_stats::kLcd);
+}
+
+} // namespace tasks
+
 void setup() {
-  EEPROM.get(0, persistent_settings);
+  storage::Load();
   Serial.begin(9600);
-  Wire.begin();
-  lcd.begin(Wire);
-  stop_button.begin(stopButtonISR);
-  snooze_button.begin(snoozeButtonISR);
-  keypad.begin();
-  mp3.begin();
-  rtc.begin();
-
-  double_high_digits::Install(lcd);
-  lcd_file = OpenAsFile(lcd);
-
-  rtc.set24Hour();
-  lcd.setFastBacklight(255, 0, 0);
+  bus::Begin();
+  for (uint8_t pin : kButtonPins) pinMode(pin, INPUT_PULLUP);
+  // Start sampling the buttons. Any count will do, as long as the interrupt
+  // comes once per Timer0 overflow.
+  OCR0A = 0x80;
+  TIMSK0 |= bit(OCIE0A);
+  EnablePinChangeInterrupt(kKeypadInterruptPin);
+  EnablePinChangeInterrupt(kRtcInterruptPin);
+  for (uint8_t d = 0; d < i2c_stats::kOther; d++) {
+    bus::BeginDevice(static_cast<i2c_stats::Device>(d));
+  }
+  sound.begin(tasks::kSoundStatusPeriodMillis, tasks::SoundFinished);
+  lcd_file = OpenAsFile(screen);
+
+  screen.setFastBacklight(255, 0, 0);
   state = WAITING;
+
+  task_scheduler.Add(tasks::kBus, bus::Poll, tasks::kBusPeriodMillis);
+  // ReadClock picks its own period.
+  task_scheduler.Add(tasks::kClock, tasks::ReadClock, task_scheduler.kNever);
+  task_scheduler.Add(tasks::kSound, tasks::PollSound,
+                     tasks::kSoundPeriodMillis);
+  task_scheduler.Add(tasks::kKeypad, tasks::ReadKeypad,
+                     task_scheduler.kNever);
+  task_scheduler.Add(tasks::kStateMachine, tasks::RunStateMachine,
+                     task_scheduler.kNever);
+  task_scheduler.Add(tasks::kDisplay, tasks::RefreshDisplay,
+                     task_scheduler.kNever);
+  task_scheduler.Add(tasks::kConsole, console::Poll,
+                     tasks::kConsolePeriodMillis);
+  task_scheduler.Add(tasks::kMemory, tasks::SampleRam,
+                     tasks::kMemoryPeriodMillis);
+
+  // If this fails, ReadClock runs first thing anyway, and keeps trying.
+  ClockSnapshot::Take(&clock_now);
+  next_alarm.Recompute(clock_now);
 }
 
 void loop() {
-  keypad.updateFIFO();
-  char button = keypad.getButton();
-  if (button != 0 && menu::CheckPasswordChar(button) && state != SOUNDING_SHABBAT) {
-    menu::Run(menu::main, menu::kMainLength);
-    EEPROM.put(0, persistent_settings);
+  i2c_stats::CountLoop();
+  {
+    profiler::Scope scope(profiler::kLoop);
+    task_scheduler.RunDue();
+    char button = tasks::TakeKey();
+    if (menu::IsOpen()) {
+      profiler::Scope menu_scope(profiler::kMenu);
+      menu::Step(button);
+    } else if (button != 0 && menu::CheckPasswordChar(button) &&
+               state != SOUNDING_SHABBAT) {
+      menu::Open();
+    }
   }
-  statemachine::Handle();
-  display::PrintMainDisplay();
-
-  delay(50);
+  // Typeahead is handled one key per pass, without waiting.
+  if (!tasks::HasKey()) task_scheduler.Idle();
 }
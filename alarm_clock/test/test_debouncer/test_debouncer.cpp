@@ -0,0 +1,99 @@
+// vim: sts=2 sw=2 fdm=syntax
+#include <unity.h>
+#include "debouncer.h"
+
+namespace {
+
+constexpr uint8_t kWindow = 5;
+constexpr uint16_t kLongPress = 2000;
+
+debouncer::Debouncer<2> buttons(kWindow, kLongPress);
+unsigned long now;
+
+// Samples button 0 once a millisecond, `millis` times, reading `raw`.
+void Hold(bool raw, unsigned long millis) {
+  for (unsigned long i = 0; i < millis; i++) buttons.sample(0, raw, now++);
+}
+
+void ExpectEvent(debouncer::EventType type) {
+  debouncer::Event e;
+  TEST_ASSERT_TRUE(buttons.take(&e));
+  TEST_ASSERT_EQUAL(0, e.button);
+  TEST_ASSERT_EQUAL(type, e.type);
+}
+
+void ExpectNoEvent() {
+  debouncer::Event e;
+  TEST_ASSERT_FALSE(buttons.take(&e));
+}
+
+void test_press_and_release() {
+  Hold(true, kWindow - 1);
+  ExpectNoEvent();
+  TEST_ASSERT_FALSE(buttons.pressed(0));
+  Hold(true, 1);
+  ExpectEvent(debouncer::kPress);
+  TEST_ASSERT_TRUE(buttons.pressed(0));
+  TEST_ASSERT_FALSE(buttons.pressed(1));
+  Hold(false, kWindow);
+  ExpectEvent(debouncer::kRelease);
+  TEST_ASSERT_FALSE(buttons.any_pressed());
+}
+
+void test_bounces_are_ignored() {
+  for (uint8_t i = 0; i < 10; i++) {
+    Hold(true, kWindow - 1);
+    Hold(false, 1);
+  }
+  ExpectNoEvent();
+  Hold(true, kWindow);
+  ExpectEvent(debouncer::kPress);
+  for (uint8_t i = 0; i < 10; i++) {
+    Hold(false, kWindow - 1);
+    Hold(true, 1);
+  }
+  ExpectNoEvent();
+  Hold(false, kWindow);
+  ExpectEvent(debouncer::kRelease);
+}
+
+void test_long_press_is_sent_once() {
+  Hold(true, kWindow);
+  ExpectEvent(debouncer::kPress);
+  Hold(true, kLongPress - 1);
+  ExpectNoEvent();
+  Hold(true, 1);
+  ExpectEvent(debouncer::kLongPress);
+  Hold(true, kLongPress * 2);
+  ExpectNoEvent();
+  Hold(false, kWindow);
+  ExpectEvent(debouncer::kRelease);
+}
+
+void test_event_times() {
+  const unsigned long start = now;
+  Hold(true, kWindow);
+  debouncer::Event e;
+  TEST_ASSERT_TRUE(buttons.take(&e));
+  TEST_ASSERT_EQUAL(start + kWindow - 1, e.millis);
+  Hold(false, kWindow);
+  buttons.take(&e);
+}
+
+} // namespace
+
+void setUp() {
+  debouncer::Event e;
+  while (buttons.take(&e)) {}
+}
+
+void tearDown() {}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_press_and_release);
+  RUN_TEST(test_bounces_are_ignored);
+  RUN_TEST(test_long_press_is_sent_once);
+  RUN_TEST(test_event_times);
+  return UNITY_END();
+}
@@ -0,0 +1,241 @@
+// vim: sts=2 sw=2 fdm=syntax
+#include <string.h>
+#include <unity.h>
+#include "eeprom_journal.h"
+
+namespace {
+
+// An EEPROM that starts out blank (all 0xFF, like a new ATmega's), and counts
+// how often each slot is written: its first byte, the low byte of its
+// sequence number, changes every time.
+//
+// It can also lose power: after cutPowerAfter(n), n more bytes are written,
+// the one after that is left erased (0xFF) rather than written, and nothing
+// else changes until powerOn().
+class Memory {
+  public:
+    static constexpr uint16_t kLength = 256;
+
+    Memory() { memset(bytes, 0xFF, sizeof(bytes)); }
+
+    uint8_t read(int idx) const { return bytes[idx]; }
+    void update(int idx, uint8_t val) {
+      if (bytes[idx] == val || off()) return;
+      if (left_ == 0) {
+        bytes[idx] = 0xFF;
+        left_ = -2;
+        return;
+      }
+      if (left_ > 0) left_--;
+      bytes[idx] = val;
+      if (idx % 8 == 0) writes[idx / 8]++;
+    }
+    uint16_t length() const { return kLength; }
+
+    void cutPowerAfter(int32_t bytes) { left_ = bytes; }
+    void powerOn() { left_ = -1; }
+    bool off() const { return left_ == -2; }
+
+    uint8_t bytes[kLength];
+    uint32_t writes[kLength / 8] = {};
+
+  private:
+    // -1 while the power stays on.
+    int32_t left_ = -1;
+};
+
+constexpr uint8_t kRecords = 6;
+typedef eeprom_journal::Journal<Memory, kRecords> Journal;
+
+void Fill(Journal::Payload& p, uint8_t id, uint16_t n) {
+  p[0] = id;
+  p[1] = n & 0xFF;
+  p[2] = n >> 8;
+  p[3] = 0x5A;
+}
+
+void ExpectRecord(Journal& journal, uint8_t id, uint16_t n) {
+  Journal::Payload expected, actual;
+  Fill(expected, id, n);
+  TEST_ASSERT_TRUE(journal.read(id, actual));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, actual, sizeof(actual));
+}
+
+void test_blank_holds_nothing() {
+  Memory memory;
+  Journal journal(memory, 0, memory.length());
+  TEST_ASSERT_EQUAL(0, journal.begin());
+  Journal::Payload p;
+  for (uint8_t id = 0; id < kRecords; id++) {
+    TEST_ASSERT_FALSE(journal.read(id, p));
+  }
+}
+
+void test_reads_back_after_restart() {
+  Memory memory;
+  Journal journal(memory, 0, memory.length());
+  journal.begin();
+  Journal::Payload p;
+  for (uint8_t id = 0; id < kRecords; id++) {
+    Fill(p, id, 1);
+    TEST_ASSERT_TRUE(journal.write(id, p));
+  }
+  Fill(p, 2, 2);
+  journal.write(2, p);
+
+  Journal restarted(memory, 0, memory.length());
+  TEST_ASSERT_EQUAL(kRecords, restarted.begin());
+  for (uint8_t id = 0; id < kRecords; id++) {
+    ExpectRecord(restarted, id, id == 2 ? 2 : 1);
+  }
+}
+
+void test_unchanged_record_isnt_written() {
+  Memory memory;
+  Journal journal(memory, 0, memory.length());
+  journal.begin();
+  Journal::Payload p;
+  Fill(p, 0, 1);
+  TEST_ASSERT_TRUE(journal.write(0, p));
+  uint8_t before[Memory::kLength];
+  memcpy(before, memory.bytes, sizeof(before));
+  TEST_ASSERT_FALSE(journal.write(0, p));
+  TEST_ASSERT_EQUAL_MEMORY(before, memory.bytes, sizeof(before));
+}
+
+void test_format_forgets_everything() {
+  Memory memory;
+  Journal journal(memory, 0, memory.length());
+  journal.begin();
+  Journal::Payload p;
+  Fill(p, 1, 1);
+  journal.write(1, p);
+  journal.format();
+  TEST_ASSERT_FALSE(journal.read(1, p));
+  Journal restarted(memory, 0, memory.length());
+  TEST_ASSERT_EQUAL(0, restarted.begin());
+}
+
+// Writing one record over and over wears every slot about equally, however
+// long the other records go unchanged.
+void test_wear_is_spread_evenly() {
+  Memory memory;
+  Journal journal(memory, 0, memory.length());
+  journal.begin();
+  Journal::Payload p;
+  for (uint8_t id = 0; id < kRecords; id++) {
+    Fill(p, id, 0);
+    journal.write(id, p);
+  }
+  for (uint16_t n = 1; n <= 3200; n++) {
+    Fill(p, 0, n);
+    journal.write(0, p);
+  }
+  uint32_t least = UINT32_MAX, most = 0;
+  for (uint32_t w : memory.writes) {
+    if (w < least) least = w;
+    if (w > most) most = w;
+  }
+  TEST_ASSERT_LESS_OR_EQUAL(least + 1, most);
+}
+
+// The sequence numbers wrap around after 65536 copies.
+void test_survives_sequence_wraparound() {
+  Memory memory;
+  uint16_t latest[kRecords] = {};
+  Journal::Payload p;
+  {
+    Journal journal(memory, 0, memory.length());
+    journal.begin();
+    for (uint32_t n = 1; n <= 70000; n++) {
+      const uint8_t id = n % 7 % kRecords;
+      latest[id] = n;
+      Fill(p, id, n);
+      journal.write(id, p);
+    }
+  }
+  Journal restarted(memory, 0, memory.length());
+  TEST_ASSERT_EQUAL(kRecords, restarted.begin());
+  for (uint8_t id = 0; id < kRecords; id++) {
+    ExpectRecord(restarted, id, latest[id]);
+  }
+  // And carries on from the newest.
+  Fill(p, 3, 1);
+  restarted.write(3, p);
+  Journal again(memory, 0, memory.length());
+  again.begin();
+  ExpectRecord(again, 3, 1);
+}
+
+// Cuts the power at every byte of a series of writes, in a region with
+// barely more slots than records, so that most writes move other records
+// along. Afterwards, the record being written has its old value or its new
+// one, and every other record has the value it had.
+void test_power_cut_keeps_a_valid_copy() {
+  constexpr uint16_t kEnd = (kRecords + 2) * 8;
+  for (int32_t cut = 0; ; cut++) {
+    Memory memory;
+    uint16_t value[kRecords];
+    Journal journal(memory, 0, kEnd);
+    journal.begin();
+    Journal::Payload p;
+    for (uint8_t id = 0; id < kRecords; id++) {
+      value[id] = id;
+      Fill(p, id, value[id]);
+      journal.write(id, p);
+    }
+
+    memory.cutPowerAfter(cut);
+    uint8_t interrupted = kRecords;
+    for (uint16_t n = 0; n < 40 && !memory.off(); n++) {
+      const uint8_t id = n * 5 % 7 % kRecords;
+      Fill(p, id, 100 + n);
+      journal.write(id, p);
+      if (memory.off()) {
+        interrupted = id;
+      } else {
+        value[id] = 100 + n;
+      }
+    }
+    // Every byte of all 40 writes has had its turn.
+    if (!memory.off()) break;
+
+    memory.powerOn();
+    Journal restarted(memory, 0, kEnd);
+    TEST_ASSERT_EQUAL(kRecords, restarted.begin());
+    for (uint8_t id = 0; id < kRecords; id++) {
+      Journal::Payload expected, actual;
+      TEST_ASSERT_TRUE(restarted.read(id, actual));
+      Fill(expected, id, value[id]);
+      if (id == interrupted && memcmp(expected, actual, sizeof(actual)) != 0) {
+        // The new copy was complete.
+        Fill(expected, id, actual[1] | (actual[2] << 8));
+        TEST_ASSERT_GREATER_OR_EQUAL(100, actual[1] | (actual[2] << 8));
+      }
+      TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, actual, sizeof(actual));
+    }
+    // And it carries on from there.
+    Fill(p, 0, 999);
+    restarted.write(0, p);
+    Journal again(memory, 0, kEnd);
+    again.begin();
+    ExpectRecord(again, 0, 999);
+  }
+}
+
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_blank_holds_nothing);
+  RUN_TEST(test_reads_back_after_restart);
+  RUN_TEST(test_unchanged_record_isnt_written);
+  RUN_TEST(test_format_forgets_everything);
+  RUN_TEST(test_wear_is_spread_evenly);
+  RUN_TEST(test_survives_sequence_wraparound);
+  RUN_TEST(test_power_cut_keeps_a_valid_copy);
+  return UNITY_END();
+}
@@ -0,0 +1,76 @@
+// vim: sts=2 sw=2 fdm=syntax
+// Runs the scenarios in this directory (see simulation.h for their format)
+// against the whole firmware, one per child process, since setup() and the
+// fakes all keep their state in globals.
+
+#include <libgen.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unity.h>
+#include "Arduino.h"
+#include "native_fakes.h"
+#include "SparkFun_Qwiic_Keypad_Arduino_Library.h"
+#include "SparkFun_RV1805.h"
+#include "simulation.h"
+
+namespace {
+
+constexpr uint8_t kKeypadInterruptPin = 4;
+constexpr uint8_t kRtcInterruptPin = 5;
+
+void RunScenario(const char* name) {
+  char path[PATH_MAX];
+  char file[PATH_MAX];
+  strncpy(file, __FILE__, sizeof(file) - 1);
+  file[sizeof(file) - 1] = '\0';
+  snprintf(path, sizeof(path), "%s/%s", dirname(file), name);
+
+  fflush(stdout);
+  const pid_t child = fork();
+  TEST_ASSERT_TRUE(child >= 0);
+  if (child == 0) {
+    if (!simulation::Load(path)) _exit(2);
+    native_fakes::Rtc()->Set(simulation::StartSeconds());
+    native_fakes::Keypad()->SetInterruptPin(kKeypadInterruptPin);
+    native_fakes::Rtc()->SetInterruptPin(kRtcInterruptPin);
+    setup();
+    fflush(stdout);
+    _exit(simulation::Run());
+  }
+  int status;
+  TEST_ASSERT_EQUAL(child, waitpid(child, &status, 0));
+  TEST_ASSERT_TRUE(WIFEXITED(status));
+  TEST_ASSERT_EQUAL(0, WEXITSTATUS(status));
+}
+
+void test_weekdays() { RunScenario("weekdays.txt"); }
+void test_late_loop() { RunScenario("late_loop.txt"); }
+void test_bus_fault() { RunScenario("bus_fault.txt"); }
+void test_several_alarms() { RunScenario("several_alarms.txt"); }
+void test_calendar() { RunScenario("calendar.txt"); }
+void test_sounds() { RunScenario("sounds.txt"); }
+void test_midnight() { RunScenario("midnight.txt"); }
+void test_around_midnight() { RunScenario("around_midnight.txt"); }
+void test_same_minute() { RunScenario("same_minute.txt"); }
+
+} // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_weekdays);
+  RUN_TEST(test_late_loop);
+  RUN_TEST(test_bus_fault);
+  RUN_TEST(test_several_alarms);
+  RUN_TEST(test_calendar);
+  RUN_TEST(test_sounds);
+  RUN_TEST(test_midnight);
+  RUN_TEST(test_around_midnight);
+  RUN_TEST(test_same_minute);
+  return UNITY_END();
+}
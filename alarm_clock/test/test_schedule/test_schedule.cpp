@@ -0,0 +1,176 @@
+// vim: sts=2 sw=2 fdm=syntax
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <unity.h>
+#include "alarm_clock.h"
+#include "native_fakes.h"
+
+namespace {
+
+constexpr uint16_t kMinutesPerDay = 24 * 60;
+constexpr uint8_t kWeekdays = 0x3E;
+constexpr uint8_t kMonday = 1;
+constexpr uint8_t kTuesday = 2;
+
+// 2026-10-19 is a Monday.
+ClockSnapshot At(uint8_t date, uint8_t hours24, uint8_t minutes) {
+  ClockSnapshot now = {};
+  now.year = 26;
+  now.month = 10;
+  now.date = date;
+  now.weekday = Weekday(now.year, now.month, date);
+  now.hours24 = hours24;
+  now.minutes = minutes;
+  return now;
+}
+
+void SetAlarm(uint8_t slot, uint8_t days, uint8_t hours24, uint8_t minutes,
+              TimeState state = ACTIVE) {
+  Alarm& alarm = persistent_settings.alarms[slot];
+  alarm.days = days;
+  alarm.time.hours24 = hours24;
+  alarm.time.minutes = minutes;
+  alarm.time.state = state;
+  alarm_index.Sort();
+}
+
+void test_empty_schedule() {
+  uint8_t slot;
+  uint16_t until;
+  TEST_ASSERT_FALSE(alarm_index.Find(0, 0, &slot, &until));
+  next_alarm.Recompute(At(19, 6, 0));
+  TEST_ASSERT_EQUAL(-1, next_alarm.day);
+}
+
+void test_find_sorts_by_time_of_day() {
+  SetAlarm(0, bit(kMonday), 7, 0);
+  SetAlarm(5, bit(kMonday), 6, 0);
+  SetAlarm(9, bit(kMonday), 6, 45);
+  uint8_t slot;
+  uint16_t until;
+  TEST_ASSERT_TRUE(alarm_index.Find(At(19, 5, 0).MinuteOfWeek(), 0, &slot,
+                                    &until));
+  TEST_ASSERT_EQUAL(5, slot);
+  TEST_ASSERT_EQUAL(60, until);
+  TEST_ASSERT_TRUE(alarm_index.Find(At(19, 6, 30).MinuteOfWeek(), 0, &slot,
+                                    &until));
+  TEST_ASSERT_EQUAL(9, slot);
+  TEST_ASSERT_EQUAL(15, until);
+  // An alarm at the very minute counts.
+  TEST_ASSERT_TRUE(alarm_index.Find(At(19, 7, 0).MinuteOfWeek(), 0, &slot,
+                                    &until));
+  TEST_ASSERT_EQUAL(0, slot);
+  TEST_ASSERT_EQUAL(0, until);
+}
+
+void test_find_wraps_around_the_week() {
+  SetAlarm(0, bit(kMonday), 7, 0);
+  uint8_t slot;
+  uint16_t until;
+  TEST_ASSERT_TRUE(alarm_index.Find(At(19, 7, 1).MinuteOfWeek(), 0, &slot,
+                                    &until));
+  TEST_ASSERT_EQUAL(0, slot);
+  TEST_ASSERT_EQUAL(7 * kMinutesPerDay - 1, until);
+  // Saturday night, into Sunday and on to Monday.
+  TEST_ASSERT_TRUE(alarm_index.Find(At(24, 23, 0).MinuteOfWeek(), 0, &slot,
+                                    &until));
+  TEST_ASSERT_EQUAL(kMinutesPerDay + 8 * 60, until);
+}
+
+void test_find_passes_over_inactive_alarms() {
+  SetAlarm(0, bit(kMonday), 6, 0, INACTIVE);
+  SetAlarm(1, bit(kMonday), 6, 30, SKIP_NEXT);
+  SetAlarm(2, bit(kTuesday), 5, 0);
+  uint8_t slot;
+  uint16_t until;
+  TEST_ASSERT_TRUE(alarm_index.Find(At(19, 5, 0).MinuteOfWeek(), 0, &slot,
+                                    &until));
+  // The skipped one is found, so that its skip can be used up.
+  TEST_ASSERT_EQUAL(1, slot);
+  TEST_ASSERT_EQUAL(90, until);
+}
+
+void test_find_skips_days() {
+  SetAlarm(0, kWeekdays, 7, 0);
+  uint8_t slot;
+  uint16_t until;
+  const uint16_t monday = At(19, 6, 0).MinuteOfWeek();
+  TEST_ASSERT_TRUE(alarm_index.Find(monday, bit(0), &slot, &until));
+  TEST_ASSERT_EQUAL(kMinutesPerDay + 60, until);
+  TEST_ASSERT_TRUE(alarm_index.Find(monday, bit(0) | bit(1) | bit(2), &slot,
+                                    &until));
+  TEST_ASSERT_EQUAL(3 * kMinutesPerDay + 60, until);
+  // Bit 7 is next Monday, before 6:00.
+  TEST_ASSERT_FALSE(alarm_index.Find(monday, 0x1F, &slot, &until));
+}
+
+void test_next_alarm_over_the_weekend() {
+  SetAlarm(3, kWeekdays, 7, 0);
+  next_alarm.Recompute(At(23, 8, 0));
+  TEST_ASSERT_EQUAL(kMonday, next_alarm.day);
+  TEST_ASSERT_EQUAL(3, next_alarm.slot);
+  TEST_ASSERT_EQUAL(3 * kMinutesPerDay - 60, next_alarm.minutes_until);
+  TEST_ASSERT_EQUAL(ACTIVE, next_alarm.time.state);
+  // Tick() counts down without searching again.
+  next_alarm.Tick(At(26, 6, 0));
+  TEST_ASSERT_EQUAL(60, next_alarm.minutes_until);
+}
+
+void test_next_alarm_when_alarms_are_off() {
+  SetAlarm(3, kWeekdays, 7, 0);
+  persistent_settings.alarms_off = true;
+  next_alarm.Recompute(At(19, 6, 0));
+  TEST_ASSERT_EQUAL(-1, next_alarm.day);
+}
+
+void test_next_alarm_passes_over_days_off() {
+  SetAlarm(3, kWeekdays, 7, 0);
+  const Date monday = Date::From(26, 10, 19);
+  Date wednesday = monday;
+  wednesday += 2;
+  calendar::SetRange(calendar::kOff, monday, wednesday, true);
+  next_alarm.Recompute(At(19, 6, 0));
+  TEST_ASSERT_EQUAL(4, next_alarm.day);
+  TEST_ASSERT_EQUAL(3 * kMinutesPerDay + 60, next_alarm.minutes_until);
+}
+
+void test_next_alarm_on_a_holiday_is_shabbat() {
+  SetAlarm(3, kWeekdays, 7, 0);
+  const Date tuesday = Date::From(26, 10, 20);
+  calendar::SetRange(calendar::kHoliday, tuesday, tuesday, true);
+  next_alarm.Recompute(At(19, 6, 0));
+  TEST_ASSERT_EQUAL(ACTIVE, next_alarm.time.state);
+  next_alarm.Recompute(At(19, 8, 0));
+  TEST_ASSERT_EQUAL(kTuesday, next_alarm.day);
+  TEST_ASSERT_EQUAL(SHABBAT, next_alarm.time.state);
+}
+
+} // namespace
+
+// Every test starts from a blank EEPROM and an empty schedule.
+void setUp() {
+  for (uint16_t i = 0; i < EEPROM.length(); i++) {
+    native_fakes::EepromWrite(i, 0xFF);
+  }
+  storage::Load();
+  calendar::Clear();
+  for (Alarm& alarm : persistent_settings.alarms) alarm = Alarm();
+  persistent_settings.alarms_off = false;
+  alarm_index.Sort();
+}
+
+void tearDown() {}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_schedule);
+  RUN_TEST(test_find_sorts_by_time_of_day);
+  RUN_TEST(test_find_wraps_around_the_week);
+  RUN_TEST(test_find_passes_over_inactive_alarms);
+  RUN_TEST(test_find_skips_days);
+  RUN_TEST(test_next_alarm_over_the_weekend);
+  RUN_TEST(test_next_alarm_when_alarms_are_off);
+  RUN_TEST(test_next_alarm_passes_over_days_off);
+  RUN_TEST(test_next_alarm_on_a_holiday_is_shabbat);
+  return UNITY_END();
+}
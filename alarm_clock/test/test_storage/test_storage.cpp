@@ -0,0 +1,168 @@
+// vim: sts=2 sw=2 fdm=syntax
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <unity.h>
+#include "alarm_clock.h"
+#include "eeprom_journal.h"
+#include "native_fakes.h"
+
+// The original layout (version 0, see storage::kLayoutVersion) is written the
+// way the original firmware wrote it, and has to load as the same settings.
+namespace {
+
+void Erase() {
+  for (uint16_t i = 0; i < EEPROM.length(); i++) {
+    native_fakes::EepromWrite(i, 0xFF);
+  }
+}
+
+void ExpectAlarm(uint8_t slot, uint8_t days, uint8_t hours24,
+                 uint8_t minutes, TimeState state, uint8_t sound = 0) {
+  const Alarm& alarm = persistent_settings.alarms[slot];
+  TEST_ASSERT_EQUAL(days, alarm.days);
+  TEST_ASSERT_EQUAL(hours24, alarm.time.hours24);
+  TEST_ASSERT_EQUAL(minutes, alarm.time.minutes);
+  TEST_ASSERT_EQUAL(state, alarm.time.state);
+  TEST_ASSERT_EQUAL(sound, alarm.sound);
+}
+
+// What version 0 loads as: one alarm per weekday, in the slot numbered after
+// it, with Monday's at 6:30 and skipped, and the others at 7:00 and active
+// except on the weekend.
+void ExpectDayAlarms() {
+  for (uint8_t day = 0; day < 7; day++) {
+    if (day == 1) {
+      ExpectAlarm(day, bit(day), 6, 30, SKIP_NEXT);
+    } else {
+      ExpectAlarm(day, bit(day), 7, 0,
+                  day == 0 || day == 6 ? INACTIVE : ACTIVE);
+    }
+  }
+  for (uint8_t slot = 7; slot < kMaxAlarms; slot++) {
+    TEST_ASSERT_EQUAL(0, persistent_settings.alarms[slot].days);
+  }
+  TEST_ASSERT_TRUE(persistent_settings.alarms_off);
+  TEST_ASSERT_EQUAL(12, persistent_settings.snooze_length);
+}
+
+TimeState DayState(uint8_t day) {
+  if (day == 1) return SKIP_NEXT;
+  return day == 0 || day == 6 ? INACTIVE : ACTIVE;
+}
+
+// Loads, and then loads again what that saved in the current layout.
+void LoadTwice() {
+  storage::Load();
+  ExpectDayAlarms();
+  storage::Load();
+  ExpectDayAlarms();
+}
+
+void test_blank_eeprom_gets_defaults() {
+  Erase();
+  storage::Load();
+  for (uint8_t day = 0; day < 7; day++) {
+    ExpectAlarm(day, bit(day), 7, 0, INACTIVE);
+  }
+  TEST_ASSERT_FALSE(persistent_settings.alarms_off);
+  TEST_ASSERT_EQUAL(9, persistent_settings.snooze_length);
+}
+
+// PersistentSettings as it was, written with EEPROM.put() at address 0.
+void test_version_0() {
+  Erase();
+  struct {
+    struct {
+      uint8_t hours24;
+      uint8_t minutes;
+      int16_t state;
+    } alarms[7];
+    bool alarms_off;
+    int16_t snooze_length;
+  } v0;
+  for (uint8_t day = 0; day < 7; day++) {
+    v0.alarms[day].hours24 = day == 1 ? 6 : 7;
+    v0.alarms[day].minutes = day == 1 ? 30 : 0;
+    v0.alarms[day].state = DayState(day);
+  }
+  v0.alarms_off = true;
+  v0.snooze_length = 12;
+  EEPROM.put(0, v0);
+  LoadTwice();
+}
+
+void test_current_version_round_trip() {
+  Erase();
+  storage::Load();
+  for (Alarm& alarm : persistent_settings.alarms) alarm = Alarm();
+  Alarm& alarm = persistent_settings.alarms[13];
+  alarm.days = 0x3E;
+  alarm.time.hours24 = 23;
+  alarm.time.minutes = 59;
+  alarm.time.state = SHABBAT;
+  alarm.sound = 200;
+  persistent_settings.alarms_off = false;
+  persistent_settings.snooze_length = 20;
+  storage::Save();
+  for (Alarm& a : persistent_settings.alarms) a = Alarm();
+  persistent_settings.snooze_length = 1;
+  storage::Load();
+  ExpectAlarm(13, 0x3E, 23, 59, SHABBAT, 200);
+  for (uint8_t slot = 0; slot < 13; slot++) {
+    TEST_ASSERT_EQUAL(0, persistent_settings.alarms[slot].days);
+  }
+  TEST_ASSERT_EQUAL(20, persistent_settings.snooze_length);
+}
+
+// Setting days in the calendar leaves the settings alone, and the other way
+// around.
+void test_calendar_is_separate_from_settings() {
+  Erase();
+  storage::Load();
+  calendar::SetRange(calendar::kHoliday, Date{26, 0}, Date{26, 364}, true);
+  persistent_settings.snooze_length = 15;
+  storage::Save();
+  storage::Load();
+  TEST_ASSERT_EQUAL(15, persistent_settings.snooze_length);
+  for (uint16_t d = 0; d < 365; d++) {
+    TEST_ASSERT_TRUE(calendar::IsSet(calendar::kHoliday, Date{26, d}));
+  }
+  for (uint8_t i = 0; i < 200; i++) {
+    persistent_settings.snooze_length = 1 + i % 20;
+    storage::Save();
+  }
+  TEST_ASSERT_TRUE(calendar::IsSet(calendar::kHoliday, Date{26, 0}));
+  TEST_ASSERT_TRUE(calendar::IsSet(calendar::kHoliday, Date{26, 364}));
+  TEST_ASSERT_FALSE(calendar::IsSet(calendar::kOff, Date{26, 0}));
+}
+
+// A layout from newer firmware can't be read, so it's replaced with the
+// defaults rather than misread.
+void test_future_version_gets_defaults() {
+  Erase();
+  // Just a header, which is record 0.
+  typedef eeprom_journal::Journal<EEPROMClass, 1> HeaderJournal;
+  HeaderJournal journal(EEPROM, 0, EEPROM.length());
+  journal.begin();
+  const HeaderJournal::Payload header = {1, 12, 0, 99};
+  journal.write(0, header);
+  storage::Load();
+  ExpectAlarm(1, bit(1), 7, 0, INACTIVE);
+  TEST_ASSERT_FALSE(persistent_settings.alarms_off);
+  TEST_ASSERT_EQUAL(9, persistent_settings.snooze_length);
+}
+
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_blank_eeprom_gets_defaults);
+  RUN_TEST(test_version_0);
+  RUN_TEST(test_current_version_round_trip);
+  RUN_TEST(test_calendar_is_separate_from_settings);
+  RUN_TEST(test_future_version_gets_defaults);
+  return UNITY_END();
+}
@@ -0,0 +1,276 @@
+#!/usr/bin/env python3
+"""Sets up an alarm clock's alarms and settings over its USB serial port.
+
+The settings file holds lines in the format of the firmware's settings
+batches (see the console namespace in src/alarm_clock.cpp), for example:
+
+    alarms clear
+    alarm 0 -MTWTF- 06:45 active
+    alarm 1 -MTWTF- 13:30 active 3
+    alarm 6 08:30 shabbat
+    alarms on
+    calendar clear
+    off 2026-12-24 2027-01-01
+    holiday 2026-10-03
+    snooze 9
+    volume 20
+
+They're sent as one batch, along with the computer's local time as a clock
+line (unless --no-clock). Then the clock's settings are read back and
+compared. Without a settings file, the clock's settings are just printed.
+
+Instead of a serial port, --native runs the native build of the firmware on
+a pseudo-terminal:
+
+    pio run -e native
+    tools/provision.py --native .pio/build/native/program alarms.txt
+
+Only needs the Python standard library.
+"""
+
+import argparse
+import datetime
+import os
+import select
+import subprocess
+import sys
+import termios
+import time
+import tty
+
+# How long to wait for the clock to answer. An Uno resets when its serial
+# port is opened, and its bootloader takes a couple of seconds.
+STARTUP_SECONDS = 5
+REPLY_SECONDS = 2
+# Retries after a checksum error, which a line lost to a full receive buffer
+# causes.
+RETRIES = 2
+
+
+def crc8(lines):
+  """The firmware's batch CRC: avr-libc's _crc8_ccitt_update, from 0xFF."""
+  crc = 0xFF
+  for line in lines:
+    for byte in (line + "\n").encode("ascii"):
+      crc ^= byte
+      for _ in range(8):
+        crc = ((crc << 1) ^ 0x07 if crc & 0x80 else crc << 1) & 0xFF
+  return crc
+
+
+class Clock:
+  """Lines to and from the firmware's serial console."""
+
+  def __init__(self, fd):
+    self.fd = fd
+    self.pending = b""
+
+  def send(self, lines):
+    os.write(self.fd, "".join(line + "\n" for line in lines).encode("ascii"))
+
+  def receive(self, timeout):
+    """Returns the next line, or None after timeout seconds."""
+    deadline = time.monotonic() + timeout
+    while b"\n" not in self.pending:
+      remaining = deadline - time.monotonic()
+      if remaining <= 0 or not select.select([self.fd], [], [], remaining)[0]:
+        return None
+      self.pending += os.read(self.fd, 256)
+    line, self.pending = self.pending.split(b"\n", 1)
+    return line.decode("ascii", "replace").strip()
+
+  def settings(self, timeout=REPLY_SECONDS):
+    """Asks for the settings batch, and returns its lines, or None."""
+    self.send(["settings"])
+    deadline = time.monotonic() + timeout
+    lines = None
+    while True:
+      line = self.receive(max(0, deadline - time.monotonic()))
+      if line is None:
+        return None
+      if line == "begin":
+        lines = []
+      elif lines is not None and line.startswith("end "):
+        if int(line[4:], 16) != crc8(lines):
+          raise SystemExit("Garbled settings from the clock")
+        return lines
+      elif lines is not None:
+        lines.append(line)
+
+  def apply(self, lines):
+    """Sends lines as a batch. Returns the errors the clock reported."""
+    self.send(["begin"] + lines + ["end %02x" % crc8(lines)])
+    errors = []
+    while True:
+      line = self.receive(REPLY_SECONDS)
+      if line is None:
+        return ["no reply"]
+      if line == "ok":
+        return errors
+      if line.startswith("error: "):
+        errors.append(line[7:])
+      elif line == "error":
+        return errors or ["checksum"]
+
+
+def open_port(path):
+  fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+  tty.setraw(fd)
+  attrs = termios.tcgetattr(fd)
+  attrs[2] |= termios.CLOCAL | termios.CREAD
+  attrs[4] = attrs[5] = termios.B9600
+  termios.tcsetattr(fd, termios.TCSANOW, attrs)
+  return fd
+
+
+def start_native(program):
+  """Runs the native build on a pseudo-terminal, in real time."""
+  controller, device = os.openpty()
+  tty.setraw(device)
+  now = datetime.datetime.now().strftime("%Y-%m-%d %H:%M:%S")
+  process = subprocess.Popen([program, "-r", "-s", "3600", "-c", now],
+                             stdin=device, stdout=device,
+                             stderr=subprocess.DEVNULL)
+  os.close(device)
+  return controller, process
+
+
+def wait_for_settings(clock):
+  """Asks until the clock answers, since it may still be starting up."""
+  deadline = time.monotonic() + STARTUP_SECONDS
+  while time.monotonic() < deadline:
+    lines = clock.settings(timeout=0.5)
+    if lines is not None:
+      return lines
+  raise SystemExit("No answer from the clock")
+
+
+def normalize(line):
+  """Writes an alarm line the way the clock prints it.
+
+  "alarm <day> HH:MM <state>" is short for an alarm on just that day, in the
+  slot numbered after it.
+  """
+  words = line.split()
+  if len(words) == 4 and words[0] == "alarm" and ":" in words[2]:
+    day = int(words[1])
+    days = "".join(c if i == day else "-" for i, c in enumerate("SMTWTFS"))
+    return " ".join(["alarm", words[1], days] + words[2:])
+  return line
+
+
+CALENDAR_FLAGS = ("off", "holiday")
+
+
+def calendar_days(line):
+  """Returns the first word of a calendar line and the dates it covers."""
+  words = line.split()
+  first = datetime.date.fromisoformat(words[1])
+  last = datetime.date.fromisoformat(words[-1])
+  return words[0], {first + datetime.timedelta(days=n)
+                    for n in range((last - first).days + 1)}
+
+
+def verify(sent, got):
+  """Returns the sent lines that the clock's settings don't match."""
+  # The clock lists each flag's days as ranges, merging adjacent ones.
+  marked = {flag: set() for flag in CALENDAR_FLAGS}
+  for line in got:
+    if line.split()[0] in CALENDAR_FLAGS:
+      flag, days = calendar_days(line)
+      marked[flag] |= days
+  # Later calendar lines win over earlier ones, so go from the last back,
+  # checking each line only for the days that no later line decided.
+  decided = {flag: set() for flag in CALENDAR_FLAGS}
+  mismatched = []
+  for line in reversed(sent):
+    if line == "calendar clear":
+      break
+    if line.split()[0] not in CALENDAR_FLAGS + ("normal",):
+      continue
+    name, days = calendar_days(line)
+    for flag in CALENDAR_FLAGS:
+      if name not in (flag, "normal"):
+        continue
+      left = days - decided[flag]
+      if ((left & marked[flag]) != (left if name == flag else set()) and
+          line not in mismatched):
+        mismatched.insert(0, line)
+      decided[flag] |= days
+  for line in sent:
+    words = normalize(line).split()
+    if words[0] in CALENDAR_FLAGS + ("normal",) or line == "calendar clear":
+      continue
+    if words[0] == "alarm" and words[2] == "-------":
+      # An emptied slot isn't listed at all.
+      if any(l.split()[:2] == words[:2] for l in got):
+        mismatched.append(line)
+    elif line.startswith("clock "):
+      clock_lines = [l for l in got if l.startswith("clock ")]
+      want = datetime.datetime.strptime(line, "clock %Y-%m-%d %H:%M:%S")
+      have = (datetime.datetime.strptime(clock_lines[0],
+                                         "clock %Y-%m-%d %H:%M:%S")
+              if clock_lines else None)
+      if have is None or abs((have - want).total_seconds()) > 2:
+        mismatched.append(line)
+    elif normalize(line) not in got:
+      mismatched.append(line)
+  return mismatched
+
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+  target = parser.add_mutually_exclusive_group(required=True)
+  target.add_argument("--port", help="the clock's serial port")
+  target.add_argument("--native", metavar="PROGRAM",
+                      help="run the native build instead")
+  parser.add_argument("--no-clock", action="store_true",
+                      help="don't set the clock to this computer's time")
+  parser.add_argument("settings", nargs="?", help="file of settings lines")
+  args = parser.parse_args()
+
+  process = None
+  if args.native:
+    fd, process = start_native(args.native)
+  else:
+    fd = open_port(args.port)
+  clock = Clock(fd)
+  try:
+    current = wait_for_settings(clock)
+    if args.settings is None:
+      print("\n".join(current))
+      return 0
+
+    start = time.monotonic()
+    with open(args.settings) as f:
+      lines = [l.strip() for l in f]
+    lines = [l for l in lines if l and not l.startswith("#")]
+    for attempt in range(RETRIES + 1):
+      batch = list(lines)
+      if not args.no_clock:
+        batch.append(datetime.datetime.now().strftime(
+            "clock %Y-%m-%d %H:%M:%S"))
+      errors = clock.apply(batch)
+      if errors != ["checksum"]:
+        break
+    if errors:
+      for error in errors:
+        print("rejected: %s" % error, file=sys.stderr)
+      return 1
+    mismatched = verify(batch, clock.settings() or [])
+    for line in mismatched:
+      print("not set: %s" % line, file=sys.stderr)
+    if mismatched:
+      return 1
+    print("%d settings sent and verified in %.0f ms" %
+          (len(batch), (time.monotonic() - start) * 1000))
+    return 0
+  finally:
+    if process is not None:
+      process.terminate()
+      process.wait()
+    os.close(fd)
+
+
+if __name__ == "__main__":
+  sys.exit(main())